@@ -0,0 +1,161 @@
+#include <string.h>
+
+#include "client_input.h"
+#include "quake_common.h"
+#include "pyminqlx.h"
+
+#define USERCMD_BUFFER_MASK (USERCMD_BUFFER_SIZE - 1)
+
+/*
+ * One ring per client. SV_ClientThink is the only writer and only ever
+ * advances head, while whoever drains it owns tail. Both are free-running
+ * counters, so head - tail is the number of unread records even after they
+ * wrap around. If nobody drains a buffer, the oldest records are simply
+ * overwritten.
+ */
+typedef struct {
+    usercmd_record_t records[USERCMD_BUFFER_SIZE];
+    unsigned int head;
+    unsigned int tail;
+} usercmd_buffer_t;
+
+static usercmd_buffer_t usercmd_buffers[MAX_CLIENTS];
+
+void UsercmdBufferAppend(int client_id, const usercmd_t* cmd) {
+    usercmd_buffer_t* buf = &usercmd_buffers[client_id];
+    unsigned int head = buf->head;
+    usercmd_record_t* rec = &buf->records[head & USERCMD_BUFFER_MASK];
+
+    rec->server_time = cmd->serverTime;
+    rec->angles[0] = cmd->angles[0];
+    rec->angles[1] = cmd->angles[1];
+    rec->angles[2] = cmd->angles[2];
+    rec->buttons = cmd->buttons;
+    rec->weapon = cmd->weapon;
+    rec->forwardmove = cmd->forwardmove;
+    rec->rightmove = cmd->rightmove;
+    rec->upmove = cmd->upmove;
+
+    // Publish the record only after it's been written in full.
+    __atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int UsercmdBufferCount(int client_id) {
+    usercmd_buffer_t* buf = &usercmd_buffers[client_id];
+    unsigned int count = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE) - buf->tail;
+    return count > USERCMD_BUFFER_SIZE ? USERCMD_BUFFER_SIZE : count;
+}
+
+/* Copies up to max of the oldest unread records into out and marks them as read.
+ * Returns the number of records copied. Safe to call from a thread other than the
+ * one running SV_ClientThink, as long as only one thread drains a given client. */
+int UsercmdBufferDrain(int client_id, usercmd_record_t* out, int max) {
+    usercmd_buffer_t* buf = &usercmd_buffers[client_id];
+    unsigned int head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    unsigned int tail = buf->tail;
+
+    if (head - tail > USERCMD_BUFFER_SIZE)
+        tail = head - USERCMD_BUFFER_SIZE;
+
+    int count = head - tail;
+    if (count > max)
+        count = max;
+
+    for (int i = 0; i < count; i++)
+        out[i] = buf->records[(tail + i) & USERCMD_BUFFER_MASK];
+
+    // If the writer lapped us while we were copying, the first few records
+    // could be a mix of old and new data, so we throw those away.
+    unsigned int now = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    int skip = (int)(now + 1 - USERCMD_BUFFER_SIZE - tail);
+    if (skip > 0) {
+        if (skip > count)
+            skip = count;
+        memmove(out, out + skip, (count - skip) * sizeof(usercmd_record_t));
+    }
+    else
+        skip = 0;
+
+    __atomic_store_n(&buf->tail, tail + count, __ATOMIC_RELEASE);
+    return count - skip;
+}
+
+void UsercmdBufferReset(int client_id) {
+    usercmd_buffer_t* buf = &usercmd_buffers[client_id];
+    __atomic_store_n(&buf->tail, __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+/*
+ * Inactivity tracking. We keep the last input we saw from each client and the
+ * level time it last changed. The player_inactive event goes off once when a
+ * client has been idle for qlx_inactivityTime seconds, and won't go off again
+ * until the client has done something in the meantime.
+ */
+typedef struct {
+    int angles[3];
+    int buttons;
+    int weapon;
+    int forwardmove;
+    int rightmove;
+    int upmove;
+} input_state_t;
+
+typedef struct {
+    input_state_t last;
+    int last_active;
+    int reported;
+} inactivity_t;
+
+static inactivity_t inactivity[MAX_CLIENTS];
+
+void InactivityReset(int client_id) {
+    memset(&inactivity[client_id], 0, sizeof(inactivity_t));
+    inactivity[client_id].last_active = level ? level->time : 0;
+}
+
+void CheckInactivity(void) {
+    if (!qlx_inactivityTime || qlx_inactivityTime->integer <= 0)
+        return;
+
+    int threshold = qlx_inactivityTime->integer * 1000;
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        client_t* cl = &svs->clients[i];
+        inactivity_t* state = &inactivity[i];
+        gentity_t* ent = &g_entities[i];
+
+        if (cl->state != CS_ACTIVE || !ent->client ||
+            ent->client->sess.sessionTeam == TEAM_SPECTATOR) {
+            state->last_active = level->time;
+            state->reported = 0;
+            continue;
+        }
+
+        input_state_t input;
+        memset(&input, 0, sizeof(input));
+        input.angles[0] = cl->lastUsercmd.angles[0];
+        input.angles[1] = cl->lastUsercmd.angles[1];
+        input.angles[2] = cl->lastUsercmd.angles[2];
+        input.buttons = cl->lastUsercmd.buttons;
+        input.weapon = cl->lastUsercmd.weapon;
+        input.forwardmove = cl->lastUsercmd.forwardmove;
+        input.rightmove = cl->lastUsercmd.rightmove;
+        input.upmove = cl->lastUsercmd.upmove;
+
+        if (memcmp(&input, &state->last, sizeof(input))) {
+            state->last = input;
+            state->last_active = level->time;
+            state->reported = 0;
+            continue;
+        }
+
+        // Level time can go backwards on map_restart and such.
+        if (level->time < state->last_active)
+            state->last_active = level->time;
+
+        int idle = level->time - state->last_active;
+        if (!state->reported && idle >= threshold) {
+            state->reported = 1;
+            PlayerInactiveDispatcher(i, idle);
+        }
+    }
+}
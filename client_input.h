@@ -0,0 +1,36 @@
+#ifndef CLIENT_INPUT_H
+#define CLIENT_INPUT_H
+
+#include <stdint.h>
+
+#include "quake_common.h"
+
+// Number of usercmds kept per client. Must be a power of two. At 125 Hz this
+// holds a bit over 4 seconds of input, so draining once a second is plenty.
+#define USERCMD_BUFFER_SIZE 512
+
+/*
+ * What we keep of a usercmd_t. It's packed so that Python can unpack a
+ * drained buffer directly with struct.iter_unpack(USERCMD_FORMAT, data).
+ */
+typedef struct __attribute__((packed)) {
+    int32_t server_time;
+    int32_t angles[3];
+    int32_t buttons;
+    uint8_t weapon;
+    int8_t forwardmove;
+    int8_t rightmove;
+    int8_t upmove;
+} usercmd_record_t;
+
+#define USERCMD_FORMAT "<6iB3b"
+
+void UsercmdBufferAppend(int client_id, const usercmd_t* cmd);
+int UsercmdBufferDrain(int client_id, usercmd_record_t* out, int max);
+int UsercmdBufferCount(int client_id);
+void UsercmdBufferReset(int client_id);
+
+void InactivityReset(int client_id);
+void CheckInactivity(void);
+
+#endif /* CLIENT_INPUT_H */
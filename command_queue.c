@@ -0,0 +1,249 @@
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "command_queue.h"
+#include "quake_common.h"
+
+/*
+ * Clients only have MAX_RELIABLE_COMMANDS slots for server commands they
+ * haven't acknowledged yet, and the engine kicks them once those run out.
+ * Instead of handing everything to the engine right away, we keep the
+ * commands of clients that are close to that limit and send them as they
+ * acknowledge the previous ones. Commands for a client with anything queued
+ * always go to the back of its queue, so the order they arrive in is kept.
+ * Commands are only held back with qlx_serverCommandPacing on, and it's off
+ * by default.
+ *
+ * Plugin threads send commands too, so the queues are locked. The lock is
+ * never held while calling into the engine, since that can end up in a hook
+ * waiting for the GIL, which the plugin thread waiting for the lock might hold.
+ */
+typedef struct {
+    unsigned int head;
+    unsigned int tail;
+    int flushing; // A thread is sending what it took off the head.
+    char cmds[COMMAND_QUEUE_SIZE][MAX_STRING_CHARS];
+} commandQueue_t;
+
+// What SendPaced should do with a command once it has decided with the lock held.
+typedef enum {
+    PACE_QUEUED,
+    PACE_SEND,
+    PACE_FLUSH_AND_SEND
+} paceAction_t;
+
+// Allocated the first time a client actually needs one, since most never will.
+static commandQueue_t* queues[MAX_CLIENTS];
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline int QueueDepth(const commandQueue_t* q) {
+    return q ? (int)(q->tail - q->head) : 0;
+}
+
+static inline int ReliableSlotsFree(const client_t* cl) {
+    return MAX_RELIABLE_COMMANDS - COMMAND_QUEUE_RESERVE - (cl->reliableSequence - cl->reliableAcknowledge);
+}
+
+static inline int PacingEnabled(void) {
+    return qlx_serverCommandPacing && qlx_serverCommandPacing->integer;
+}
+
+// Returns the length of the text between the quotes if cmd is a print with a
+// single argument, or -1 if it's anything else.
+static int PrintLength(const char* cmd) {
+    int len = strlen(cmd);
+    if (strncmp(cmd, "print \"", 7))
+        return -1;
+
+    while (len > 7 && cmd[len - 1] == '\n')
+        len--;
+    if (len < 8 || cmd[len - 1] != '"' || memchr(cmd + 7, '"', len - 8))
+        return -1;
+
+    return len - 8;
+}
+
+// The client prints the argument of each print as it gets it, so two of them
+// in a row are the same thing as one with both texts joined.
+static int CoalescePrint(commandQueue_t* q, const char* cmd) {
+    if (!QueueDepth(q))
+        return 0;
+
+    char* last = q->cmds[(q->tail - 1) & (COMMAND_QUEUE_SIZE - 1)];
+    int last_len = PrintLength(last);
+    if (last_len < 0)
+        return 0;
+    int len = PrintLength(cmd);
+    if (len < 0 || 7 + last_len + len + 2 > COMMAND_COALESCE_LENGTH)
+        return 0;
+
+    memcpy(last + 7 + last_len, cmd + 7, len);
+    strcpy(last + 7 + last_len + len, "\"\n");
+    return 1;
+}
+
+// Sends the commands at the head of a client's queue for as long as it has
+// room for them. Only one thread flushes a queue at a time, and commands for
+// a client sent meanwhile are queued behind the ones it's sending.
+static void FlushQueue(int client_id, int ignore_limit) {
+    client_t* cl = &svs->clients[client_id];
+    char cmd[MAX_STRING_CHARS];
+
+    pthread_mutex_lock(&queue_lock);
+    commandQueue_t* q = queues[client_id];
+    if (!q || q->flushing) {
+        pthread_mutex_unlock(&queue_lock);
+        return;
+    }
+
+    q->flushing = 1;
+    while (QueueDepth(q) && (ignore_limit || ReliableSlotsFree(cl) > 0)) {
+        strcpy(cmd, q->cmds[q->head & (COMMAND_QUEUE_SIZE - 1)]);
+        q->head++;
+        pthread_mutex_unlock(&queue_lock);
+        SV_SendServerCommand(cl, "%s", cmd);
+        pthread_mutex_lock(&queue_lock);
+    }
+    q->flushing = 0;
+    pthread_mutex_unlock(&queue_lock);
+}
+
+// Must be called with the lock held.
+static int BroadcastCongested(void) {
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        client_t* cl = &svs->clients[i];
+        if (cl->state < CS_PRIMED)
+            continue;
+        else if (QueueDepth(queues[i]) || (queues[i] && queues[i]->flushing) ||
+                 (PacingEnabled() && ReliableSlotsFree(cl) <= 0))
+            return 1;
+    }
+
+    return 0;
+}
+
+// Must be called with the lock held. Queues the command if it has to wait,
+// and otherwise tells the caller to send it once the lock is released.
+static paceAction_t PaceCommand(client_t* cl, const char* cmd) {
+    int client_id = cl - svs->clients;
+    commandQueue_t* q = queues[client_id];
+    int busy = QueueDepth(q) || (q && q->flushing);
+
+    // Nothing will follow a disconnect, so there's no point holding it back.
+    // Anything too long for a slot is left to the engine to deal with.
+    if (!strncmp(cmd, "disconnect", 10) || strlen(cmd) >= MAX_STRING_CHARS)
+        return PACE_FLUSH_AND_SEND;
+    else if (!busy && (!PacingEnabled() || ReliableSlotsFree(cl) > 0))
+        return PACE_SEND;
+    else if (CoalescePrint(q, cmd))
+        return PACE_QUEUED;
+    else if (QueueDepth(q) == COMMAND_QUEUE_SIZE) {
+        // The client isn't keeping up at all. Hand everything over and let
+        // the engine deal with it like it would have if we weren't here.
+        return PACE_FLUSH_AND_SEND;
+    }
+
+    if (!q) {
+        q = queues[client_id] = calloc(1, sizeof(commandQueue_t));
+        if (!q)
+            return PACE_SEND;
+    }
+
+    strcpy(q->cmds[q->tail & (COMMAND_QUEUE_SIZE - 1)], cmd);
+    q->tail++;
+    return PACE_QUEUED;
+}
+
+static void SendPaced(client_t* cl, const char* cmd) {
+    pthread_mutex_lock(&queue_lock);
+    paceAction_t action = PaceCommand(cl, cmd);
+    pthread_mutex_unlock(&queue_lock);
+
+    if (action == PACE_FLUSH_AND_SEND)
+        FlushQueue(cl - svs->clients, 1);
+    if (action != PACE_QUEUED)
+        SV_SendServerCommand(cl, "%s", cmd);
+}
+
+static void SendPacedBroadcast(const char* cmd) {
+    pthread_mutex_lock(&queue_lock);
+    int congested = BroadcastCongested();
+    pthread_mutex_unlock(&queue_lock);
+
+    if (!congested) {
+        SV_SendServerCommand(NULL, "%s", cmd);
+        return;
+    }
+
+    // Someone can't take it right now, so send it to everyone individually
+    // instead. The engine prints broadcast prints to the console, so we do
+    // the same with the newlines escaped like it does.
+    if (!strncmp(cmd, "print", 5)) {
+        char expanded[MAX_STRING_CHARS * 2];
+        int j = 0;
+        for (int i = 0; cmd[i] && j < (int)sizeof(expanded) - 2; i++) {
+            if (cmd[i] == '\n') {
+                expanded[j++] = '\\';
+                expanded[j++] = 'n';
+            }
+            else
+                expanded[j++] = cmd[i];
+        }
+        expanded[j] = 0;
+        My_Com_Printf("broadcast: %s\n", expanded);
+    }
+
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        if (svs->clients[i].state >= CS_PRIMED)
+            SendPaced(&svs->clients[i], cmd);
+    }
+}
+
+void SendPacedServerCommand(client_t* cl, const char* cmd) {
+    if (cl)
+        SendPaced(cl, cmd);
+    else
+        SendPacedBroadcast(cmd);
+}
+
+// Called once per frame, after the game has run and before the engine sends
+// out snapshots.
+void DrainCommandQueues(void) {
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        pthread_mutex_lock(&queue_lock);
+        commandQueue_t* q = queues[i];
+        int pending = QueueDepth(q);
+        if (pending && svs->clients[i].state < CS_CONNECTED) {
+            q->head = q->tail;
+            pending = 0;
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        if (pending)
+            FlushQueue(i, !PacingEnabled());
+    }
+}
+
+int CommandQueueDepth(int client_id) {
+    pthread_mutex_lock(&queue_lock);
+    int depth = QueueDepth(queues[client_id]);
+    pthread_mutex_unlock(&queue_lock);
+    return depth;
+}
+
+int CommandQueueFull(int client_id) {
+    return CommandQueueDepth(client_id) >= COMMAND_QUEUE_SIZE;
+}
+
+void CommandQueueReset(int client_id) {
+    pthread_mutex_lock(&queue_lock);
+    if (queues[client_id])
+        queues[client_id]->head = queues[client_id]->tail = 0;
+    pthread_mutex_unlock(&queue_lock);
+}
+
+void ClearCommandQueues(void) {
+    for (int i = 0; i < MAX_CLIENTS; i++)
+        CommandQueueReset(i);
+}
@@ -0,0 +1,21 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include "quake_common.h"
+
+// Number of server commands we hold back per client. Must be a power of two.
+#define COMMAND_QUEUE_SIZE 128
+// Reliable command slots we never fill up ourselves, so that whatever the
+// engine sends while we're draining doesn't push the client into an overflow.
+#define COMMAND_QUEUE_RESERVE 16
+// Don't coalesce prints beyond this. Matches MAX_MSG_LENGTH on the Python side.
+#define COMMAND_COALESCE_LENGTH 1000
+
+void SendPacedServerCommand(client_t* cl, const char* cmd);
+void DrainCommandQueues(void);
+int CommandQueueDepth(int client_id);
+int CommandQueueFull(int client_id);
+void CommandQueueReset(int client_id);
+void ClearCommandQueues(void);
+
+#endif /* COMMAND_QUEUE_H */
@@ -92,7 +92,7 @@ void __cdecl PyCommand(void) {
 	if (!custom_command_handler) {
 	        return; // No registered handler.
 	}
-	PyGILState_STATE gstate = PyGILState_Ensure();
+	ENGINE_GIL_ENSURE(gstate);
 
 	PyObject* result = PyObject_CallFunction(custom_command_handler, "s", Cmd_Args());
 	if (result == Py_False) {
@@ -100,13 +100,28 @@ void __cdecl PyCommand(void) {
 	}
 
 	Py_XDECREF(result);
-	PyGILState_Release(gstate);
+	EngineGILRelease(gstate);
+}
+
+void __cdecl PyConsoleCommand(void) {
+    if (!console_command_handler)
+        return;
+    ENGINE_GIL_ENSURE(gstate);
+
+    PyObject* result = PyObject_CallFunction(console_command_handler, "ss", Cmd_Argv(0), Cmd_Args());
+    if (result == Py_False)
+        Com_Printf("The command failed to be executed. pyminqlx found no handler.\n");
+
+    Py_XDECREF(result);
+    EngineGILRelease(gstate);
 }
 
 void __cdecl RestartPython(void) {
     Com_Printf("Restarting Python...\n");
-    if (PyMinqlx_IsInitialized())
-    	PyMinqlx_Finalize();
+    if (PyMinqlx_IsInitialized() && PyMinqlx_Finalize() == PYM_WORKERS_RUNNING_ERROR) {
+        Com_Printf("Python wasn't restarted, since some workers didn't stop in time.\n");
+        return;
+    }
     PyMinqlx_Initialize();
     // minqlx initializes after the first new game starts, but since the game already
     // start, we manually trigger the event to make it initialize properly.
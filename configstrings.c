@@ -0,0 +1,109 @@
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "configstrings.h"
+#include "quake_common.h"
+#include "pyminqlx.h"
+
+/*
+ * With qlx_coalesceConfigstrings on, configstrings set during a frame are
+ * held back and only the last value for each index is set once the frame is
+ * done, in the order they were first set. Values that end up the same as what
+ * clients already have aren't set at all. Either way, set_configstring only
+ * goes off once per index and frame. Reads during the frame see the held back
+ * values, so the game finding free model and sound indices still works.
+ *
+ * Plugin threads can set configstrings too, so the pending values are locked.
+ */
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static char* pending[MAX_CONFIGSTRINGS];
+static int pending_order[MAX_CONFIGSTRINGS];
+static int pending_count;
+static int batching;
+
+void BeginConfigstringBatch(void) {
+    pthread_mutex_lock(&pending_lock);
+    batching = qlx_coalesceConfigstrings && qlx_coalesceConfigstrings->integer;
+    pthread_mutex_unlock(&pending_lock);
+}
+
+int DeferConfigstring(int index, const char* value) {
+    if (index < 0 || index >= MAX_CONFIGSTRINGS)
+        return 0;
+
+    pthread_mutex_lock(&pending_lock);
+    char* copy = batching ? strdup(value) : NULL;
+    if (copy) {
+        if (pending[index])
+            free(pending[index]);
+        else
+            pending_order[pending_count++] = index;
+        pending[index] = copy;
+    }
+    pthread_mutex_unlock(&pending_lock);
+
+    return copy != NULL;
+}
+
+int CopyPendingConfigstring(int index, char* buffer, int bufferSize) {
+    if (index < 0 || index >= MAX_CONFIGSTRINGS || bufferSize < 1)
+        return 0;
+
+    pthread_mutex_lock(&pending_lock);
+    int found = pending[index] != NULL;
+    if (found) {
+        strncpy(buffer, pending[index], bufferSize - 1);
+        buffer[bufferSize - 1] = 0;
+    }
+    pthread_mutex_unlock(&pending_lock);
+
+    return found;
+}
+
+void FlushConfigstrings(void) {
+    static char current[MAX_MSGLEN];
+    static char* values[MAX_CONFIGSTRINGS];
+    static int order[MAX_CONFIGSTRINGS];
+
+    // Anything set while flushing, by plugins or otherwise, goes straight through.
+    pthread_mutex_lock(&pending_lock);
+    batching = 0;
+    int count = pending_count;
+    for (int i = 0; i < count; i++) {
+        order[i] = pending_order[i];
+        values[i] = pending[order[i]];
+        pending[order[i]] = NULL;
+    }
+    pending_count = 0;
+    pthread_mutex_unlock(&pending_lock);
+
+    for (int i = 0; i < count; i++) {
+        int index = order[i];
+        char* value = values[i];
+
+        SV_GetConfigstring(index, current, sizeof(current));
+        if (strcmp(current, value)) {
+            char* res = SetConfigstringDispatcher(index, value);
+            // NULL means stop the event.
+            if (res)
+                SV_SetConfigstring(index, res);
+        }
+
+        free(value);
+    }
+}
+
+// For when the frame never finished, like if the map changed in the middle of it.
+void DiscardPendingConfigstrings(void) {
+    pthread_mutex_lock(&pending_lock);
+    batching = 0;
+
+    for (int i = 0; i < pending_count; i++) {
+        free(pending[pending_order[i]]);
+        pending[pending_order[i]] = NULL;
+    }
+
+    pending_count = 0;
+    pthread_mutex_unlock(&pending_lock);
+}
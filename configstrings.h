@@ -0,0 +1,12 @@
+#ifndef CONFIGSTRINGS_H
+#define CONFIGSTRINGS_H
+
+#include "quake_common.h"
+
+void BeginConfigstringBatch(void);
+int DeferConfigstring(int index, const char* value);
+int CopyPendingConfigstring(int index, char* buffer, int bufferSize);
+void FlushConfigstrings(void);
+void DiscardPendingConfigstrings(void);
+
+#endif /* CONFIGSTRINGS_H */
@@ -50,6 +50,7 @@ SV_Map_f_ptr SV_Map_f;
 SV_SetConfigstring_ptr SV_SetConfigstring;
 SV_GetConfigstring_ptr SV_GetConfigstring;
 SV_DropClient_ptr SV_DropClient;
+SV_ClientThink_ptr SV_ClientThink;
 Sys_SetModuleOffset_ptr Sys_SetModuleOffset;
 SV_SpawnServer_ptr SV_SpawnServer;
 Cmd_ExecuteString_ptr Cmd_ExecuteString;
@@ -76,6 +77,16 @@ int bg_numItems;
 
 // Cvars.
 cvar_t* sv_maxclients;
+cvar_t* qlx_perfMap;
+#ifndef NOPY
+cvar_t* qlx_inactivityTime;
+cvar_t* qlx_serverCommandPacing;
+cvar_t* qlx_coalesceConfigstrings;
+cvar_t* qlx_batchEvents;
+cvar_t* qlx_slowFrameInterval;
+cvar_t* qlx_injectBudget;
+cvar_t* qlx_gilYield;
+#endif
 
 // TODO: Make it output everything to a file too.
 void DebugPrint(const char* fmt, ...) {
@@ -127,6 +138,7 @@ static void SearchFunctions(void) {
 	STATIC_SEARCH(SV_SetConfigstring, PTRN_SV_SETCONFIGSTRING, MASK_SV_SETCONFIGSTRING);
 	STATIC_SEARCH(SV_GetConfigstring, PTRN_SV_GETCONFIGSTRING, MASK_SV_GETCONFIGSTRING);
 	STATIC_SEARCH(SV_DropClient, PTRN_SV_DROPCLIENT, MASK_SV_DROPCLIENT);
+	STATIC_SEARCH(SV_ClientThink, PTRN_SV_CLIENTTHINK, MASK_SV_CLIENTTHINK);
 	STATIC_SEARCH(Sys_SetModuleOffset, PTRN_SYS_SETMODULEOFFSET, MASK_SYS_SETMODULEOFFSET);
 	STATIC_SEARCH(SV_SpawnServer, PTRN_SV_SPAWNSERVER, MASK_SV_SPAWNSERVER);
 	STATIC_SEARCH(Cmd_ExecuteString, PTRN_CMD_EXECUTESTRING, MASK_CMD_EXECUTESTRING);
@@ -221,6 +233,20 @@ void InitializeVm(void) {
 // Called after the game is initialized.
 void InitializeCvars(void) {
     sv_maxclients = Cvar_FindVar("sv_maxclients");
+    // Created here rather than by Python, since it works without Python too.
+    qlx_perfMap = Cvar_Get("qlx_perfMap", "0", 0);
+#ifndef NOPY
+    // Python creates these in initialize_cvars along with the rest. That only
+    // happens once the first game starts, after the first G_InitGame, so
+    // My_SV_SpawnServer calls this again after it. Until then they're NULL.
+    qlx_inactivityTime = Cvar_FindVar("qlx_inactivityTime");
+    qlx_serverCommandPacing = Cvar_FindVar("qlx_serverCommandPacing");
+    qlx_coalesceConfigstrings = Cvar_FindVar("qlx_coalesceConfigstrings");
+    qlx_batchEvents = Cvar_FindVar("qlx_batchEvents");
+    qlx_slowFrameInterval = Cvar_FindVar("qlx_slowFrameInterval");
+    qlx_injectBudget = Cvar_FindVar("qlx_injectBudget");
+    qlx_gilYield = Cvar_FindVar("qlx_gilYield");
+#endif
     
     cvars_initialized = 1;
 }
@@ -232,6 +258,12 @@ void EntryPoint(void) {
 
 	SearchFunctions();
 
+#ifndef NOPY
+	// The server loads us from the thread it runs in, and hooks go off there
+	// before Python is even initialized.
+	on_engine_thread = 1;
+#endif
+
 	// Initialize some key structure pointers before hooking, since we
 	// might use some of the functions that could be hooked later to
 	// get the pointer, such as SV_SetConfigstring.
@@ -0,0 +1,226 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "entity_index.h"
+#include "quake_common.h"
+#include "common.h"
+
+#define ENTITY_WORDS (MAX_GENTITIES / 64)
+#define CLASS_POINTER_SLOTS 1024 // Must be a power of two.
+
+typedef struct {
+    uint64_t bits[ENTITY_WORDS];
+} entitySet_t;
+
+// What the entity looked like the last time we indexed it.
+typedef struct {
+    int inuse;
+    int etype;
+    int gitype;
+    int class_id;
+    int dropped;
+    const char* classname;
+    const gitem_t* item;
+} entityKey_t;
+
+static entitySet_t all_entities;
+static entitySet_t by_etype[MAX_INDEXED_ETYPES];
+static entitySet_t by_gitype[MAX_INDEXED_GITYPES];
+static entitySet_t by_class[MAX_ENTITY_CLASSES];
+static entitySet_t dropped_items;
+static entityKey_t keys[MAX_GENTITIES];
+
+// Plugin threads query the index too, and without a GIL they can do so while
+// the engine thread updates it.
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Classnames are interned into small integer IDs. Most entities share their
+ * classname pointer with others of the same kind (bg_itemlist or the spawn
+ * string), so we look the pointer up first and only fall back to comparing
+ * strings the first time we see a new pointer.
+ */
+static char class_names[MAX_ENTITY_CLASSES][64];
+static int class_count;
+static const char* class_pointers[CLASS_POINTER_SLOTS];
+static int class_pointer_ids[CLASS_POINTER_SLOTS];
+
+static inline void SetAdd(entitySet_t* set, int i) {
+    set->bits[i / 64] |= 1ULL << (i % 64);
+}
+
+static inline void SetRemove(entitySet_t* set, int i) {
+    set->bits[i / 64] &= ~(1ULL << (i % 64));
+}
+
+static int LookupClass(const char* classname) {
+    for (int i = 0; i < class_count; i++) {
+        if (!strcmp(class_names[i], classname))
+            return i;
+    }
+
+    return -1;
+}
+
+static int InternClass(const char* classname) {
+    if (!classname)
+        return -1;
+
+    unsigned int slot = ((pint)classname >> 3) & (CLASS_POINTER_SLOTS - 1);
+    for (unsigned int probe = 0; probe < CLASS_POINTER_SLOTS; probe++) {
+        unsigned int s = (slot + probe) & (CLASS_POINTER_SLOTS - 1);
+        if (class_pointers[s] == classname)
+            return class_pointer_ids[s];
+        else if (class_pointers[s])
+            continue;
+
+        // First time we see this pointer.
+        int id = LookupClass(classname);
+        if (id == -1) {
+            if (class_count == MAX_ENTITY_CLASSES || strlen(classname) >= sizeof(class_names[0]))
+                return -1;
+            id = class_count++;
+            strcpy(class_names[id], classname);
+        }
+
+        class_pointers[s] = classname;
+        class_pointer_ids[s] = id;
+        return id;
+    }
+
+    // Pointer table is full. Not going to happen on any real map.
+    return LookupClass(classname);
+}
+
+static void Unlink(int i) {
+    entityKey_t* key = &keys[i];
+    if (!key->inuse)
+        return;
+
+    SetRemove(&all_entities, i);
+    SetRemove(&by_etype[key->etype], i);
+    if (key->gitype != -1)
+        SetRemove(&by_gitype[key->gitype], i);
+    if (key->class_id != -1)
+        SetRemove(&by_class[key->class_id], i);
+    if (key->dropped)
+        SetRemove(&dropped_items, i);
+    key->inuse = 0;
+}
+
+// Brings the index up to date with whatever entity i looks like right now.
+static void Update(int i) {
+    gentity_t* ent = &g_entities[i];
+    entityKey_t* key = &keys[i];
+
+    if (!ent->inuse) {
+        Unlink(i);
+        return;
+    }
+
+    int etype = ent->s.eType < MAX_INDEXED_ETYPES ? ent->s.eType : MAX_INDEXED_ETYPES - 1;
+    int dropped = (ent->flags & FL_DROPPED_ITEM) != 0;
+    if (key->inuse && key->etype == etype && key->classname == ent->classname &&
+        key->item == ent->item && key->dropped == dropped)
+        return; // Nothing changed.
+
+    Unlink(i);
+    key->inuse = 1;
+    key->etype = etype;
+    key->classname = ent->classname;
+    key->item = ent->item;
+    key->dropped = dropped;
+    key->class_id = InternClass(ent->classname);
+    key->gitype = ent->item && ent->item->giType < MAX_INDEXED_GITYPES ? (int)ent->item->giType : -1;
+
+    SetAdd(&all_entities, i);
+    SetAdd(&by_etype[etype], i);
+    if (key->gitype != -1)
+        SetAdd(&by_gitype[key->gitype], i);
+    if (key->class_id != -1)
+        SetAdd(&by_class[key->class_id], i);
+    if (dropped)
+        SetAdd(&dropped_items, i);
+}
+
+/*
+ * The game spawns, frees and changes entities all over the place without us
+ * knowing, G_Spawn included, so every query checks each slot against what we
+ * indexed. That's only integer and pointer comparisons, so it's a lot cheaper
+ * than the strcmp loops it replaces, and entities spawned earlier in the same
+ * frame are never missed.
+ */
+static void Sync(void) {
+    int num_entities = level->num_entities;
+    if (num_entities <= 0 || num_entities > MAX_GENTITIES)
+        num_entities = MAX_GENTITIES;
+
+    for (int i = 0; i < num_entities; i++)
+        Update(i);
+    for (int i = num_entities; i < MAX_GENTITIES; i++)
+        Unlink(i);
+}
+
+// Called whenever the game is initialized. The strings classnames point to are
+// allocated from a pool that's reset, so old pointers can't be trusted anymore.
+void EntityIndexReset(void) {
+    pthread_mutex_lock(&index_lock);
+    memset(&all_entities, 0, sizeof(all_entities));
+    memset(by_etype, 0, sizeof(by_etype));
+    memset(by_gitype, 0, sizeof(by_gitype));
+    memset(by_class, 0, sizeof(by_class));
+    memset(&dropped_items, 0, sizeof(dropped_items));
+    memset(keys, 0, sizeof(keys));
+    memset(class_pointers, 0, sizeof(class_pointers));
+    class_count = 0;
+    pthread_mutex_unlock(&index_lock);
+}
+
+static int Find(const entityFilter_t* filter, int* out, int max) {
+    Sync();
+
+    entitySet_t match = all_entities;
+    if (filter->classname) {
+        int class_id = LookupClass(filter->classname);
+        if (class_id == -1)
+            return 0;
+        for (int w = 0; w < ENTITY_WORDS; w++)
+            match.bits[w] &= by_class[class_id].bits[w];
+    }
+    if (filter->etype != -1) {
+        if (filter->etype < 0 || filter->etype >= MAX_INDEXED_ETYPES - 1)
+            return 0;
+        for (int w = 0; w < ENTITY_WORDS; w++)
+            match.bits[w] &= by_etype[filter->etype].bits[w];
+    }
+    if (filter->gitype != -1) {
+        if (filter->gitype < 0 || filter->gitype >= MAX_INDEXED_GITYPES)
+            return 0;
+        for (int w = 0; w < ENTITY_WORDS; w++)
+            match.bits[w] &= by_gitype[filter->gitype].bits[w];
+    }
+    if (filter->dropped != -1) {
+        for (int w = 0; w < ENTITY_WORDS; w++)
+            match.bits[w] &= filter->dropped ? dropped_items.bits[w] : ~dropped_items.bits[w];
+    }
+
+    int count = 0;
+    for (int w = 0; w < ENTITY_WORDS && count < max; w++) {
+        uint64_t bits = match.bits[w];
+        while (bits && count < max) {
+            out[count++] = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+        }
+    }
+
+    return count;
+}
+
+/* Writes the IDs of up to max in-use entities matching the filter into out in
+ * ascending order. Returns the number of entities written. */
+int FindEntities(const entityFilter_t* filter, int* out, int max) {
+    pthread_mutex_lock(&index_lock);
+    int count = Find(filter, out, max);
+    pthread_mutex_unlock(&index_lock);
+    return count;
+}
@@ -0,0 +1,23 @@
+#ifndef ENTITY_INDEX_H
+#define ENTITY_INDEX_H
+
+#include "quake_common.h"
+
+// Distinct classnames we keep track of. Maps rarely use more than a hundred.
+#define MAX_ENTITY_CLASSES 256
+// eTypes at or above this, which are really just events, share the last bucket.
+#define MAX_INDEXED_ETYPES 32
+#define MAX_INDEXED_GITYPES 16
+
+// Filters for FindEntities.
+typedef struct {
+    const char* classname; // NULL for any.
+    int etype; // -1 for any.
+    int gitype; // -1 for any.
+    int dropped; // -1 for any, otherwise whether or not FL_DROPPED_ITEM is set.
+} entityFilter_t;
+
+void EntityIndexReset(void);
+int FindEntities(const entityFilter_t* filter, int* out, int max);
+
+#endif /* ENTITY_INDEX_H */
@@ -0,0 +1,137 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "event_batch.h"
+#include "quake_common.h"
+#include "pyminqlx.h"
+
+/*
+ * With qlx_batchEvents on, console prints, server commands and configstrings
+ * that nothing needs to see right away are written to an arena during the
+ * frame instead of going into Python one at a time. At the end of the frame,
+ * all of it is passed to the batched_events handler as a single list. Those
+ * that did go through the regular event are added as well, so the list is
+ * always everything that happened during the frame.
+ *
+ * Prints can come from other threads, so the arena is behind a lock, and only
+ * the engine thread ever hands it to Python, at the end of the frame. Once the
+ * arena is full, whatever doesn't fit goes through the regular event right
+ * away, just like with batching off.
+ */
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+    int count;
+} arena_t;
+
+static arena_t arena;
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static int batching;
+static int sync_required[BATCH_EVENT_TYPES];
+
+static inline size_t RecordSize(int len) {
+    // Keep records aligned so that they can be used where they are.
+    return (offsetof(batchedEvent_t, text) + len + 1 + 3) & ~(size_t)3;
+}
+
+static void DeliverBatch(void) {
+    pthread_mutex_lock(&arena_lock);
+    arena_t batch = arena;
+    memset(&arena, 0, sizeof(arena));
+    pthread_mutex_unlock(&arena_lock);
+
+    if (!batch.count) {
+        free(batch.data);
+        return;
+    }
+
+    const batchedEvent_t** events = malloc(batch.count * sizeof(batchedEvent_t*));
+    if (events) {
+        size_t offset = 0;
+        for (int i = 0; i < batch.count; i++) {
+            events[i] = (const batchedEvent_t*)(batch.data + offset);
+            offset += RecordSize(events[i]->len);
+        }
+        BatchedEventsDispatcher(events, batch.count);
+        free(events);
+    }
+
+    free(batch.data);
+}
+
+static int Append(batchEventType_t type, int arg, const char* text, int dispatched) {
+    int len = strlen(text);
+    size_t size = RecordSize(len);
+    if (size > EVENT_BATCH_SIZE)
+        return 0;
+
+    pthread_mutex_lock(&arena_lock);
+    if (arena.size + size > EVENT_BATCH_SIZE) {
+        pthread_mutex_unlock(&arena_lock);
+        return 0;
+    }
+
+    if (arena.size + size > arena.capacity) {
+        size_t capacity = arena.capacity ? arena.capacity : 64 * 1024;
+        while (capacity < arena.size + size)
+            capacity *= 2;
+
+        char* data = realloc(arena.data, capacity);
+        if (!data) {
+            pthread_mutex_unlock(&arena_lock);
+            return 0;
+        }
+        arena.data = data;
+        arena.capacity = capacity;
+    }
+
+    batchedEvent_t* e = (batchedEvent_t*)(arena.data + arena.size);
+    e->type = type;
+    e->arg = arg;
+    e->dispatched = dispatched;
+    e->len = len;
+    memcpy(e->text, text, len + 1);
+    arena.size += size;
+    arena.count++;
+
+    pthread_mutex_unlock(&arena_lock);
+    return 1;
+}
+
+void BeginEventBatch(void) {
+    __atomic_store_n(&batching, qlx_batchEvents && qlx_batchEvents->integer && batched_events_handler, __ATOMIC_RELAXED);
+}
+
+// Returns 1 if the event was buffered, in which case it shouldn't be dispatched.
+int DeferEvent(batchEventType_t type, int arg, const char* text) {
+    if (!__atomic_load_n(&batching, __ATOMIC_RELAXED) || __atomic_load_n(&sync_required[type], __ATOMIC_RELAXED))
+        return 0;
+
+    // Python works out votes, game states and rounds from these, and it needs
+    // the old value to do so, so they always go through right away.
+    if (type == BATCH_SET_CONFIGSTRING &&
+            (arg == CS_SERVERINFO || arg == CS_VOTE_STRING || arg == CS_ROUND_STATUS))
+        return 0;
+
+    return Append(type, arg, text, 0);
+}
+
+// For events that were dispatched right away.
+void RecordEvent(batchEventType_t type, int arg, const char* text) {
+    if (__atomic_load_n(&batching, __ATOMIC_RELAXED))
+        Append(type, arg, text, 1);
+}
+
+void FlushEventBatch(void) {
+    __atomic_store_n(&batching, 0, __ATOMIC_RELAXED);
+    DeliverBatch();
+}
+
+// Python sets this while any plugin hooks the regular event, since those
+// can cancel or modify it and need to see it as it happens.
+void SetEventSync(batchEventType_t type, int sync) {
+    __atomic_store_n(&sync_required[type], sync, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,29 @@
+#ifndef EVENT_BATCH_H
+#define EVENT_BATCH_H
+
+typedef enum {
+    BATCH_CONSOLE_PRINT,
+    BATCH_SERVER_COMMAND,
+    BATCH_SET_CONFIGSTRING,
+    BATCH_EVENT_TYPES
+} batchEventType_t;
+
+// How much we buffer in a frame. Past that, events go through the regular
+// event right away instead.
+#define EVENT_BATCH_SIZE (1024 * 1024)
+
+typedef struct {
+    int type;
+    int arg; // Client ID for server commands, index for configstrings.
+    int dispatched; // Whether or not it already went through the regular event.
+    int len;
+    char text[];
+} batchedEvent_t;
+
+void BeginEventBatch(void);
+int DeferEvent(batchEventType_t type, int arg, const char* text);
+void RecordEvent(batchEventType_t type, int arg, const char* text);
+void FlushEventBatch(void);
+void SetEventSync(batchEventType_t type, int sync);
+
+#endif /* EVENT_BATCH_H */
@@ -14,6 +14,15 @@
 
 #ifndef NOPY
 #include "pyminqlx.h"
+#include "client_input.h"
+#include "zones.h"
+#include "spatial_index.h"
+#include "entity_index.h"
+#include "command_queue.h"
+#include "configstrings.h"
+#include "timers.h"
+#include "inject_queue.h"
+#include "subinterpreters.h"
 #endif
 
 // qagame module.
@@ -67,7 +76,15 @@ void __cdecl My_G_InitGame(int levelTime, int randomSeed, int restart) {
     }
     InitializeCvars();
 
+    // HookVm has just hooked the VM again if the map changed.
+    if (qlx_perfMap->integer)
+        WritePerfMap();
+
 #ifndef NOPY
+    EntityIndexReset();
+    SyncTimerClock();
+    ResolveSpawnTemplates(); // g_factory might have changed.
+
     if (restart)
 	   NewGameDispatcher(restart);
 #endif
@@ -77,14 +94,14 @@ void __cdecl My_G_InitGame(int levelTime, int randomSeed, int restart) {
 
 #ifndef NOPY
 void __cdecl My_SV_ExecuteClientCommand(client_t *cl, char *s, qboolean clientOK) {
+    HookEnter(__func__);
     char* res = s;
-    if (clientOK && cl->gentity) {
+    if (clientOK && cl->gentity)
         res = ClientCommandDispatcher(cl - svs->clients, s);
-        if (!res)
-            return;
-    }
 
-    SV_ExecuteClientCommand(cl, res, clientOK);
+    if (res)
+        SV_ExecuteClientCommand(cl, res, clientOK);
+    HookLeave();
 }
 
 void __cdecl My_SV_SendServerCommand(client_t* cl, char* fmt, ...) {
@@ -95,19 +112,20 @@ void __cdecl My_SV_SendServerCommand(client_t* cl, char* fmt, ...) {
 	vsnprintf((char *)buffer, sizeof(buffer), fmt, argptr);
 	va_end(argptr);
 
+    HookEnter(__func__);
     char* res = buffer;
 	if (cl && cl->gentity)
 		res = ServerCommandDispatcher(cl - svs->clients, buffer);
 	else if (cl == NULL)
 		res = ServerCommandDispatcher(-1, buffer);
 
-	if (!res)
-		return;
-
-    SV_SendServerCommand(cl, res);
+	if (res)
+		SendPacedServerCommand(cl, res);
+    HookLeave();
 }
 
 void __cdecl My_SV_ClientEnterWorld(client_t* client, usercmd_t* cmd) {
+	HookEnter(__func__);
 	clientState_t state = client->state; // State before we call real one.
 	SV_ClientEnterWorld(client, cmd);
 
@@ -117,6 +135,7 @@ void __cdecl My_SV_ClientEnterWorld(client_t* client, usercmd_t* cmd) {
 	if (client->gentity != NULL && state == CS_PRIMED) {
 		ClientLoadedDispatcher(client - svs->clients);
 	}
+	HookLeave();
 }
 
 void __cdecl My_SV_SetConfigstring(int index, char* value) {
@@ -130,16 +149,48 @@ void __cdecl My_SV_SetConfigstring(int index, char* value) {
     }
 
     if (!value) value = "";
+    // Coalescing, so this one's set at the end of the frame instead.
+    if (DeferConfigstring(index, value))
+        return;
+
+    HookEnter(__func__);
     char* res = SetConfigstringDispatcher(index, value);
     // NULL means stop the event.
     if (res)
         SV_SetConfigstring(index, res);
+    HookLeave();
+}
+
+void __cdecl My_SV_GetConfigstring(int index, char* buffer, int bufferSize) {
+    // Configstrings we're holding back have to be visible to whoever reads
+    // them, or the game would for instance reuse model indices it just took.
+    if (CopyPendingConfigstring(index, buffer, bufferSize))
+        return;
+
+    SV_GetConfigstring(index, buffer, bufferSize);
 }
 
 void __cdecl My_SV_DropClient(client_t* drop, const char* reason) {
+    HookEnter(__func__);
     ClientDisconnectDispatcher(drop - svs->clients, reason);
 
+    // Whatever's still queued won't matter anymore.
+    CommandQueueReset(drop - svs->clients);
     SV_DropClient(drop, reason);
+    UsercmdBufferReset(drop - svs->clients);
+    ResetClientZones(drop - svs->clients);
+    HookLeave();
+}
+
+void __cdecl My_SV_ClientThink(client_t* cl, usercmd_t* cmd) {
+    // Only record actual gameplay input. Usercmds also arrive while the
+    // client is still loading the map, and those are of no use to anyone.
+    if (cl->state == CS_ACTIVE)
+        UsercmdBufferAppend(cl - svs->clients, cmd);
+
+    HookEnter(__func__);
+    SV_ClientThink(cl, cmd);
+    HookLeave();
 }
 
 void __cdecl My_Com_Printf(char* fmt, ...) {
@@ -149,45 +200,107 @@ void __cdecl My_Com_Printf(char* fmt, ...) {
     vsnprintf(buf, sizeof(buf), fmt, args);
     va_end(args);
 
+    HookEnter(__func__);
     char* res = ConsolePrintDispatcher(buf);
     // NULL means stop the event.
     if (res)
         Com_Printf(buf);
+    HookLeave();
 }
 
 void __cdecl My_SV_SpawnServer(char* server, qboolean killBots) {
+    HookEnter(__func__);
+    // In case the last frame never finished.
+    FlushEventBatch();
+
+    // Queued commands were meant for the old map, and configstring updates
+    // in particular would be wrong if they arrived after the new gamestate.
+    ClearCommandQueues();
+    DiscardPendingConfigstrings();
     SV_SpawnServer(server, killBots);
 
+    // Zones are only meaningful for the map they were added on.
+    ClearZones();
+    SpatialIndexInvalidate();
+
     // We call NewGameDispatcher here instead of G_InitGame when it's not just a map_restart,
     // otherwise configstring 0 and such won't be initialized and we can't instantiate minqlx.Game.
     NewGameDispatcher(qfalse);
+    // The first new_game is where Python creates its cvars.
+    InitializeCvars();
+    HookLeave();
 }
 
 void  __cdecl My_G_RunFrame(int time) {
+    HookEnter(__func__);
+    BeginConfigstringBatch();
+    BeginEventBatch();
+
+    // Whatever other threads posted since the last frame goes first.
+    DrainInjectQueue();
+    DrainWorkerMessages();
+
+    // Only enters Python if any timers went off.
+    RunTimers();
+
     // Dropping frames is probably not a good idea, so we don't allow cancelling.
     FrameDispatcher();
 
+    // For handlers that don't need to run every frame. Python only registers
+    // the handler while slow_frame is hooked. An interval of 0 or less turns it off.
+    static int slow_frame_count;
+    if (qlx_slowFrameInterval && qlx_slowFrameInterval->integer > 0 &&
+        ++slow_frame_count >= qlx_slowFrameInterval->integer) {
+        slow_frame_count = 0;
+        SlowFrameDispatcher();
+    }
+
     G_RunFrame(time);
+    SpatialIndexInvalidate();
+
+    CheckInactivity();
+    CheckZones();
+
+    FlushConfigstrings();
+    // After anything above has had a chance to send more.
+    DrainCommandQueues();
+    FlushEventBatch();
+    GILFrameDone();
+    HookLeave();
 }
 
 char* __cdecl My_ClientConnect(int clientNum, qboolean firstTime, qboolean isBot) {
+	char* res = NULL;
+	HookEnter(__func__);
 	if (firstTime) {
-		char* res = ClientConnectDispatcher(clientNum, isBot);
-		if (res && !isBot) {
-			return res;
-		}
+		UsercmdBufferReset(clientNum);
+		CommandQueueReset(clientNum);
+		InactivityReset(clientNum);
+		ResetClientZones(clientNum);
+		res = ClientConnectDispatcher(clientNum, isBot);
+		// Bots can't be refused.
+		if (isBot)
+			res = NULL;
 	}
 
-	return ClientConnect(clientNum, firstTime, isBot);
+	if (!res)
+		res = ClientConnect(clientNum, firstTime, isBot);
+	HookLeave();
+	return res;
 }
 
 void __cdecl My_ClientSpawn(gentity_t* ent) {
+    HookEnter(__func__);
     ClientSpawn(ent);
     
     // Since we won't ever stop the real function from being called,
     // we trigger the event after calling the real one. This will allow
     // us to set weapons and such without it getting overriden later.
+    // Python only registers the handler while a plugin hooks player_spawn,
+    // so with just a template this doesn't enter Python at all.
+    ApplySpawnTemplate(ent);
     ClientSpawnDispatcher(ent - g_entities);
+    HookLeave();
 }
 
 void __cdecl My_G_StartKamikaze(gentity_t* ent) {
@@ -208,6 +321,7 @@ void __cdecl My_G_StartKamikaze(gentity_t* ent) {
         is_used_on_demand = 0;
     }
 
+    HookEnter(__func__);
     if (is_used_on_demand)
        KamikazeUseDispatcher(client_id);
 
@@ -215,6 +329,7 @@ void __cdecl My_G_StartKamikaze(gentity_t* ent) {
 
     if (client_id != -1)
         KamikazeExplodeDispatcher(client_id, is_used_on_demand);
+    HookLeave();
 }
 #endif
 
@@ -222,13 +337,13 @@ void __cdecl My_G_StartKamikaze(gentity_t* ent) {
 void HookStatic(void) {
 	int res, failed = 0;
     DebugPrint("Hooking...\n");
-    res = Hook((void*)Cmd_AddCommand, My_Cmd_AddCommand, (void*)&Cmd_AddCommand);
+    res = Hook((void*)Cmd_AddCommand, My_Cmd_AddCommand, (void*)&Cmd_AddCommand, "Cmd_AddCommand");
 	if (res) {
 		DebugPrint("ERROR: Failed to hook Cmd_AddCommand: %d\n", res);
 		failed = 1;
 	}
 
-    res = Hook((void*)Sys_SetModuleOffset, My_Sys_SetModuleOffset, (void*)&Sys_SetModuleOffset);
+    res = Hook((void*)Sys_SetModuleOffset, My_Sys_SetModuleOffset, (void*)&Sys_SetModuleOffset, "Sys_SetModuleOffset");
     if (res) {
 		DebugPrint("ERROR: Failed to hook Sys_SetModuleOffset: %d\n", res);
 		failed = 1;
@@ -238,43 +353,55 @@ void HookStatic(void) {
     //    ONLY NEEDED FOR PYTHON
     // ==============================
 #ifndef NOPY
-    res = Hook((void*)SV_ExecuteClientCommand, My_SV_ExecuteClientCommand, (void*)&SV_ExecuteClientCommand);
+    res = Hook((void*)SV_ExecuteClientCommand, My_SV_ExecuteClientCommand, (void*)&SV_ExecuteClientCommand, "SV_ExecuteClientCommand");
     if (res) {
 		DebugPrint("ERROR: Failed to hook SV_ExecuteClientCommand: %d\n", res);
 		failed = 1;
     }
 
-    res = Hook((void*)SV_ClientEnterWorld, My_SV_ClientEnterWorld, (void*)&SV_ClientEnterWorld);
+    res = Hook((void*)SV_ClientEnterWorld, My_SV_ClientEnterWorld, (void*)&SV_ClientEnterWorld, "SV_ClientEnterWorld");
 	if (res) {
 		DebugPrint("ERROR: Failed to hook SV_ClientEnterWorld: %d\n", res);
 		failed = 1;
 	}
 
-	res = Hook((void*)SV_SendServerCommand, My_SV_SendServerCommand, (void*)&SV_SendServerCommand);
+	res = Hook((void*)SV_SendServerCommand, My_SV_SendServerCommand, (void*)&SV_SendServerCommand, "SV_SendServerCommand");
 	if (res) {
 		DebugPrint("ERROR: Failed to hook SV_SendServerCommand: %d\n", res);
 		failed = 1;
 	}
 
-    res = Hook((void*)SV_SetConfigstring, My_SV_SetConfigstring, (void*)&SV_SetConfigstring);
+    res = Hook((void*)SV_SetConfigstring, My_SV_SetConfigstring, (void*)&SV_SetConfigstring, "SV_SetConfigstring");
     if (res) {
         DebugPrint("ERROR: Failed to hook SV_SetConfigstring: %d\n", res);
         failed = 1;
     }
 
-    res = Hook((void*)SV_DropClient, My_SV_DropClient, (void*)&SV_DropClient);
+    res = Hook((void*)SV_GetConfigstring, My_SV_GetConfigstring, (void*)&SV_GetConfigstring, "SV_GetConfigstring");
+    if (res) {
+        DebugPrint("ERROR: Failed to hook SV_GetConfigstring: %d\n", res);
+        failed = 1;
+    }
+
+    res = Hook((void*)SV_DropClient, My_SV_DropClient, (void*)&SV_DropClient, "SV_DropClient");
     if (res) {
         DebugPrint("ERROR: Failed to hook SV_DropClient: %d\n", res);
         failed = 1;
     }
 
-    res = Hook((void*)Com_Printf, My_Com_Printf, (void*)&Com_Printf);
+    res = Hook((void*)SV_ClientThink, My_SV_ClientThink, (void*)&SV_ClientThink, "SV_ClientThink");
+    if (res) {
+        DebugPrint("ERROR: Failed to hook SV_ClientThink: %d\n", res);
+        failed = 1;
+    }
+
+    res = Hook((void*)Com_Printf, My_Com_Printf, (void*)&Com_Printf, "Com_Printf");
     if (res) {
         DebugPrint("ERROR: Failed to hook Com_Printf: %d\n", res);
         failed = 1;
     }
 
-    res = Hook((void*)SV_SpawnServer, My_SV_SpawnServer, (void*)&SV_SpawnServer);
+    res = Hook((void*)SV_SpawnServer, My_SV_SpawnServer, (void*)&SV_SpawnServer, "SV_SpawnServer");
     if (res) {
         DebugPrint("ERROR: Failed to hook SV_SpawnServer: %d\n", res);
         failed = 1;
@@ -316,21 +443,21 @@ void HookVm(void) {
 	*(void**)(vm_call_table + RELOFFSET_VM_CALL_RUNFRAME) = My_G_RunFrame;
 
 	int res, failed = 0, count = 0;
-	res = Hook((void*)ClientConnect, My_ClientConnect, (void*)&ClientConnect);
+	res = Hook((void*)ClientConnect, My_ClientConnect, (void*)&ClientConnect, "ClientConnect");
 	if (res) {
 		DebugPrint("ERROR: Failed to hook ClientConnect: %d\n", res);
 		failed = 1;
 	}
   count++;
 
-    res = Hook((void*)G_StartKamikaze, My_G_StartKamikaze, (void*)&G_StartKamikaze);
+    res = Hook((void*)G_StartKamikaze, My_G_StartKamikaze, (void*)&G_StartKamikaze, "G_StartKamikaze");
     if (res) {
         DebugPrint("ERROR: Failed to hook G_StartKamikaze: %d\n", res);
         failed = 1;
     }
     count++;
 
-    res = Hook((void*)ClientSpawn, My_ClientSpawn, (void*)&ClientSpawn);
+    res = Hook((void*)ClientSpawn, My_ClientSpawn, (void*)&ClientSpawn, "ClientSpawn");
     if (res) {
         DebugPrint("ERROR: Failed to hook ClientSpawn: %d\n", res);
         failed = 1;
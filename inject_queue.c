@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "inject_queue.h"
+#include "quake_common.h"
+#include "pyminqlx.h"
+
+/*
+ * A queue any thread can post operations to, to have them carried out by
+ * the engine thread at the start of the next frame. Posting never blocks
+ * and never needs the GIL, so native threads can use it as well.
+ *
+ * It's an intrusive multi-producer, single-consumer queue: producers swap
+ * themselves in as the head with a single atomic exchange and then link
+ * the previous head to themselves. The consumer walks from the tail. A
+ * producer that has swapped but not linked yet just makes the consumer stop
+ * early, and what it posted is picked up the next frame.
+ */
+typedef struct injectNode_s {
+    struct injectNode_s* next;
+    injectOp_t op;
+    int arg;
+    void* data;
+    char* key;
+    char* value;
+    char strings[];
+} injectNode_t;
+
+static injectNode_t stub;
+static injectNode_t* head = &stub; // Producers.
+static injectNode_t* tail = &stub; // Consumer.
+static int queued; // Posted but not taken yet. Only used to know when to stop.
+
+static void Push(injectNode_t* node) {
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    injectNode_t* prev = __atomic_exchange_n(&head, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+static injectNode_t* Pop(void) {
+    injectNode_t* t = tail;
+    injectNode_t* next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+
+    if (t == &stub) {
+        if (!next)
+            return NULL;
+        tail = t = next;
+        next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next) {
+        tail = next;
+        return t;
+    }
+
+    // t is the last one, unless someone is in the middle of adding another.
+    if (t != __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    // Put the stub back in so that t can be taken without leaving the queue empty.
+    Push(&stub);
+    next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        tail = next;
+        return t;
+    }
+
+    return NULL;
+}
+
+int InjectOperation(injectOp_t op, int arg, const char* key, const char* value, void* data) {
+    size_t key_len = key ? strlen(key) + 1 : 0;
+    size_t value_len = value ? strlen(value) + 1 : 0;
+    injectNode_t* node = malloc(sizeof(injectNode_t) + key_len + value_len);
+    if (!node)
+        return 0;
+
+    node->op = op;
+    node->arg = arg;
+    node->data = data;
+    node->key = key ? memcpy(node->strings, key, key_len) : NULL;
+    node->value = value ? memcpy(node->strings + key_len, value, value_len) : NULL;
+
+    Push(node);
+    __atomic_add_fetch(&queued, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static void RunCallbacks(void** callbacks, int* count) {
+    if (*count) {
+        QueuedCallbackDispatcher(callbacks, *count);
+        *count = 0;
+    }
+}
+
+static void Run(injectNode_t* node) {
+    switch (node->op) {
+    case INJECT_CONSOLE_COMMAND:
+        Cmd_ExecuteString(node->value);
+        break;
+    case INJECT_SERVER_COMMAND:
+        if (node->arg == -1)
+            My_SV_SendServerCommand(NULL, "%s\n", node->value);
+        else if (node->arg >= 0 && node->arg < sv_maxclients->integer && svs->clients[node->arg].state == CS_ACTIVE)
+            My_SV_SendServerCommand(&svs->clients[node->arg], "%s\n", node->value);
+        break;
+    case INJECT_CONFIGSTRING:
+        My_SV_SetConfigstring(node->arg, node->value);
+        break;
+    case INJECT_CVAR:
+        if (!Cvar_FindVar(node->key))
+            Cvar_Get(node->key, node->value, 0);
+        else
+            Cvar_Set2(node->key, node->value, qfalse);
+        break;
+    default:
+        break;
+    }
+}
+
+// Called at the start of every frame. Only takes what was there when it
+// started, so operations that post more operations can't keep it going.
+void DrainInjectQueue(void) {
+    int count = __atomic_load_n(&queued, __ATOMIC_RELAXED);
+    if (!count)
+        return;
+
+    int budget = qlx_injectBudget ? qlx_injectBudget->integer : 0;
+    if (budget > 0 && count > budget)
+        count = budget;
+
+    // Consecutive callbacks go to Python together, so the GIL is only taken
+    // once for each run of them.
+    void** callbacks = malloc(count * sizeof(void*));
+    if (!callbacks)
+        return;
+    int callback_count = 0;
+    int taken = 0;
+    for (; taken < count; taken++) {
+        injectNode_t* node = Pop();
+        if (!node)
+            break;
+
+        if (node->op == INJECT_CALLBACK)
+            callbacks[callback_count++] = node->data;
+        else {
+            RunCallbacks(callbacks, &callback_count);
+            Run(node);
+        }
+        free(node);
+    }
+    RunCallbacks(callbacks, &callback_count);
+    free(callbacks);
+
+    __atomic_sub_fetch(&queued, taken, __ATOMIC_RELAXED);
+}
+
+// Drops whatever is still queued, passing the data of callbacks to release.
+void ClearInjectQueue(void (*release)(void*)) {
+    injectNode_t* node;
+    while ((node = Pop())) {
+        if (node->op == INJECT_CALLBACK)
+            release(node->data);
+        free(node);
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_RELAXED);
+    }
+}
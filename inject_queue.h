@@ -0,0 +1,16 @@
+#ifndef INJECT_QUEUE_H
+#define INJECT_QUEUE_H
+
+typedef enum {
+    INJECT_CONSOLE_COMMAND, // value: The command.
+    INJECT_SERVER_COMMAND, // arg: Client ID, or -1 for everyone. value: The command.
+    INJECT_CONFIGSTRING, // arg: Index. value: The configstring.
+    INJECT_CVAR, // key: Name. value: Value.
+    INJECT_CALLBACK // data: Passed to QueuedCallbackDispatcher. Needs Python.
+} injectOp_t;
+
+int InjectOperation(injectOp_t op, int arg, const char* key, const char* value, void* data);
+void DrainInjectQueue(void);
+void ClearInjectQueue(void (*release)(void*));
+
+#endif /* INJECT_QUEUE_H */
@@ -5,8 +5,12 @@
 #define CORE_MODULE "minqlx.zip"
 
 #include <Python.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include "quake_common.h"
+#include "event_batch.h"
+#include "subinterpreters.h"
 
 // Used to determine whether or not initialization worked.
 typedef enum {
@@ -14,7 +18,8 @@ typedef enum {
     PYM_PY_INIT_ERROR,
     PYM_MAIN_SCRIPT_ERROR,
     PYM_ALREADY_INITIALIZED,
-    PYM_NOT_INITIALIZED_ERROR
+    PYM_NOT_INITIALIZED_ERROR,
+    PYM_WORKERS_RUNNING_ERROR
 } PyMinqlx_InitStatus_t;
 
 // Used primarily in Python, but defined here and added using PyModule_AddIntMacro().
@@ -53,11 +58,20 @@ extern PyObject* client_connect_handler;
 extern PyObject* client_loaded_handler;
 extern PyObject* client_disconnect_handler;
 extern PyObject* frame_handler;
+extern PyObject* slow_frame_handler;
+extern PyObject* timer_handler;
+extern PyObject* queued_callbacks_handler;
 extern PyObject* new_game_handler;
 extern PyObject* set_configstring_handler;
 extern PyObject* rcon_handler;
 extern PyObject* console_print_handler;
 extern PyObject* client_spawn_handler;
+extern PyObject* player_inactive_handler;
+extern PyObject* zone_enter_handler;
+extern PyObject* zone_exit_handler;
+extern PyObject* zone_dwell_handler;
+extern PyObject* batched_events_handler;
+extern PyObject* worker_message_handler;
 
 extern PyObject* kamikaze_use_handler;
 extern PyObject* kamikaze_explode_handler;
@@ -65,12 +79,71 @@ extern PyObject* kamikaze_explode_handler;
 // Custom console command handler. These are commands added through Python that can be used
 // from the console or using RCON.
 extern PyObject* custom_command_handler;
+// Same as above, but for the console commands added with minqlx.register_console_command.
+extern PyObject* console_command_handler;
 
 // We need to explicitly tell player_info to not return None in the case where
 // we are inside My_ClientConnect, because we want to call Python code before
 // the real ClientConnect is called, which is where it sets the connection
 // state from CS_FREE to CS_CONNECTED. Same thing with My_SV_DropClient.
-extern int allow_free_client;
+extern __thread int allow_free_client;
+
+// Set for the thread the engine runs in, from the moment the library is loaded.
+extern __thread int on_engine_thread;
+
+// How long the engine thread waited for the GIL, per place it takes it from.
+typedef struct gilStats_s {
+    const char* name;
+    uint64_t calls;
+    uint64_t wait_ns;
+    uint64_t max_wait_ns;
+    struct gilStats_s* next;
+    int listed;
+} gilStats_t;
+
+extern gilStats_t* gil_stats;
+// Guards gil_stats and the counters below, which gil_stats() can read and reset
+// from any thread. Never held while calling into Python.
+extern pthread_mutex_t gil_stats_lock;
+extern uint64_t frame_gil_wait_ns;
+extern uint64_t max_frame_gil_wait_ns;
+extern uint64_t total_frame_gil_wait_ns;
+extern uint64_t gil_frames;
+extern int engine_wants_gil;
+
+// Use instead of PyGILState_Ensure on the engine thread, so that the wait is
+// counted and threads using minqlx.yield_to_engine know to let go of the GIL.
+// EngineGILRelease goes with it instead of PyGILState_Release.
+PyGILState_STATE EngineGILEnsure(gilStats_t* stats);
+void GILFrameDone(void);
+void EngineGILRelease(PyGILState_STATE gstate);
+#define ENGINE_GIL_ENSURE(gstate) \
+    static gilStats_t gil_stats_entry = {__func__}; \
+    PyGILState_STATE gstate = EngineGILEnsure(&gil_stats_entry)
+
+// The hooks and dispatchers the engine thread is currently in, outermost first.
+// Read by qlx_profile's sampler. The names are string literals, so a sample that
+// races a push just sees a stale one. Plugin threads go through hooks too, like
+// when send_server_command makes the engine print, but they leave the stack alone
+// so that only the engine thread ever writes to it.
+#define MAX_HOOK_DEPTH 32
+extern const char* hook_stack[MAX_HOOK_DEPTH];
+extern int hook_depth;
+
+static inline void HookEnter(const char* name) {
+    if (!on_engine_thread)
+        return;
+
+    int depth = hook_depth;
+    if (depth >= 0 && depth < MAX_HOOK_DEPTH)
+        hook_stack[depth] = name;
+    __atomic_store_n(&hook_depth, depth + 1, __ATOMIC_RELEASE);
+}
+
+static inline void HookLeave(void) {
+    if (on_engine_thread)
+        __atomic_store_n(&hook_depth, hook_depth - 1, __ATOMIC_RELEASE);
+}
 
 /* Dispatchers. These are called by hooks or whatever and should dispatch events to Python handlers.
  * The return values will often determine what is passed on to the engine. You could for instance
@@ -80,6 +153,9 @@ extern int allow_free_client;
 char* ClientCommandDispatcher(int client_id, char* cmd);
 char* ServerCommandDispatcher(int client_id, char* cmd);
 void FrameDispatcher(void);
+void SlowFrameDispatcher(void);
+void TimerDispatcher(void** callbacks, int count);
+void QueuedCallbackDispatcher(void** callbacks, int count);
 char* ClientConnectDispatcher(int client_id, int is_bot);
 int ClientLoadedDispatcher(int client_id);
 void ClientDisconnectDispatcher(int client_id, const char* reason);
@@ -88,6 +164,16 @@ char* SetConfigstringDispatcher(int index, char* value);
 void RconDispatcher(const char* cmd);
 char* ConsolePrintDispatcher(char* cmd);
 void ClientSpawnDispatcher(int client_id);
+void PlayerInactiveDispatcher(int client_id, int idle_time);
+void ZoneEnterDispatcher(int client_id, int zone_id);
+void ZoneExitDispatcher(int client_id, int zone_id, int inside_time);
+void ZoneDwellDispatcher(int client_id, int zone_id, int inside_time);
+void BatchedEventsDispatcher(const batchedEvent_t** events, int count);
+void WorkerMessageDispatcher(const workerMessage_t* messages, int count);
+
+// Spawn templates. Applied in My_ClientSpawn without going through Python.
+void ResolveSpawnTemplates(void);
+void ApplySpawnTemplate(gentity_t* ent);
 
 void KamikazeUseDispatcher(int client_id);
 void KamikazeExplodeDispatcher(int client_id, int is_used_on_demand);
@@ -18,5 +18,10 @@ from ._game import *
 from ._events import *
 from ._commands import *
 from ._handlers import *
+from ._async import *
+from ._gc import *
+from ._ledger import *
+from ._memory import *
 from ._player import *
+from ._profiler import *
 from ._zmq import *
@@ -0,0 +1,122 @@
+# minqlx - Extends Quake Live's dedicated server with extra functionality and scripting.
+# Copyright (C) 2015 Mino <mino@minomino.org>
+
+# This file is part of minqlx.
+
+# minqlx is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# minqlx is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with minqlx. If not, see <http://www.gnu.org/licenses/>.
+
+import minqlx
+import asyncio
+import functools
+import threading
+import traceback
+import time
+
+# ====================================================================
+#                              ASYNCIO
+# ====================================================================
+
+# The loop is only created once something uses it, and it never runs on its own.
+# Instead, handle_frame advances it a little every frame on the main thread, so
+# coroutines can do whatever they want with the game state without any locking.
+_loop = None
+_loop_lock = threading.Lock()
+_time_slice = 0.005
+
+class _FrameEventLoop(asyncio.SelectorEventLoop):
+    """Keeps count of the callbacks it has run that were scheduled with call_soon or
+    call_soon_threadsafe, which is how tasks and futures schedule their next steps.
+    That's how step_async_loop tells whether a pass over the loop did anything.
+
+    """
+    def __init__(self):
+        super().__init__()
+        self.callbacks_run = 0
+
+    def _counted(self, callback, *args):
+        self.callbacks_run += 1
+        return callback(*args)
+
+    def call_soon(self, callback, *args, context=None):
+        return super().call_soon(self._counted, callback, *args, context=context)
+
+    def call_soon_threadsafe(self, callback, *args, context=None):
+        return super().call_soon_threadsafe(self._counted, callback, *args, context=context)
+
+def async_loop():
+    """Returns minqlx's event loop. Coroutines scheduled on it run on the main thread,
+    during frames, for up to qlx_asyncTimeSlice milliseconds each frame.
+
+    :returns: asyncio.AbstractEventLoop
+
+    """
+    global _loop
+    with _loop_lock:
+        if _loop is None:
+            _loop = _FrameEventLoop()
+        return _loop
+
+def _log_result(plugin, future):
+    if future.cancelled():
+        return
+
+    e = future.exception()
+    if e is not None:
+        logger = minqlx.get_logger(plugin)
+        for line in "".join(traceback.format_exception(type(e), e, e.__traceback__)).rstrip("\n").split("\n"):
+            logger.error(line)
+
+def run_async(coro, plugin=None):
+    """Schedules a coroutine on minqlx's event loop. Any exception it raises is logged.
+    Safe to call from any thread.
+
+    :param coro: The coroutine to run.
+    :param plugin: The plugin the coroutine belongs to, used for logging.
+    :type plugin: minqlx.Plugin
+    :returns: asyncio.Task if called from the main thread, otherwise concurrent.futures.Future.
+
+    """
+    loop = async_loop()
+    if threading.current_thread() is threading.main_thread():
+        future = loop.create_task(coro)
+    else:
+        future = asyncio.run_coroutine_threadsafe(coro, loop)
+
+    future.add_done_callback(functools.partial(_log_result, plugin))
+    return future
+
+def configure_async():
+    """Reads qlx_asyncTimeSlice. Called at startup and on every map change."""
+    global _time_slice
+    try:
+        _time_slice = max(int(minqlx.get_cvar("qlx_asyncTimeSlice")), 0) / 1000
+    except (TypeError, ValueError):
+        _time_slice = 0.005
+
+def step_async_loop():
+    """Advances the event loop without blocking. Called every frame by handle_frame."""
+    if _loop is None:
+        return
+
+    deadline = time.perf_counter() + _time_slice
+    while True:
+        # Stopping right away makes run_forever() poll for I/O without waiting
+        # and run whatever callbacks were ready, once.
+        callbacks_run = _loop.callbacks_run
+        _loop.call_soon(_loop.stop)
+        _loop.run_forever()
+        # Keep going while the last pass did more than stop the loop, since that
+        # usually means more became ready, and there's time left to do it.
+        if _loop.callbacks_run - callbacks_run <= 1 or time.perf_counter() >= deadline:
+            break
@@ -17,6 +17,7 @@
 # along with minqlx. If not, see <http://www.gnu.org/licenses/>.
 
 import minqlx
+import asyncio
 import re
 
 MAX_MSG_LENGTH = 1000
@@ -58,7 +59,18 @@ class Command:
         logger = minqlx.get_logger(self.plugin)
         logger.debug("{} executed: {} @ {} -> {}"
             .format(player.steam_id, self.name[0], self.plugin.name, channel))
-        return self.handler(player, msg.split(), channel)
+        res = minqlx.LEDGER.call(self.plugin.name, "command", self.name[0], self.handler, player, msg.split(), channel)
+        if asyncio.iscoroutine(res):
+            # Handlers can be coroutines, in which case only usage can be replied with.
+            task = minqlx.run_async(res, self.plugin)
+            task.add_done_callback(lambda t: self._reply_usage(t, channel))
+            return minqlx.RET_NONE
+
+        return res
+
+    def _reply_usage(self, task, channel):
+        if not task.cancelled() and task.exception() is None and task.result() == minqlx.RET_USAGE and self.usage:
+            channel.reply("^7Usage: ^6{} {}".format(self.name[0], self.usage))
 
     def is_eligible_name(self, name):
         if self.prefix:
@@ -383,6 +395,26 @@ class ClientCommandChannel(AbstractChannel):
         self.tell_channel.reply(msg, limit, delimiter)
 
 
+# ====================================================================
+#                          CONSOLE COMMANDS
+# ====================================================================
+
+def register_console_command(name, handler):
+    """Adds a command to the server console itself, as opposed to the commands plugins
+    add, which go through chat or rcon. The handler is called with the arguments as
+    a single string. Adding a command that already exists replaces its handler.
+
+    :param name: The name of the command.
+    :type name: str
+    :param handler: The function to be called when the command is used.
+    :type handler: callable
+
+    """
+    name = name.lower()
+    if name not in CONSOLE_COMMANDS:
+        minqlx.add_named_console_command(name)
+    CONSOLE_COMMANDS[name] = handler
+
 # ====================================================================
 #                          MODULE CONSTANTS
 # ====================================================================
@@ -394,3 +426,4 @@ BLUE_TEAM_CHAT_CHANNEL = BlueTeamChatChannel()
 FREE_CHAT_CHANNEL = FreeChatChannel()
 SPECTATOR_CHAT_CHANNEL = SpectatorChatChannel()
 CONSOLE_CHANNEL = ConsoleChannel()
+CONSOLE_COMMANDS = {}
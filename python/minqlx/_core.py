@@ -22,7 +22,9 @@
 
 import minqlx
 import minqlx.database
+import concurrent.futures
 import collections
+import functools
 import subprocess
 import threading
 import traceback
@@ -31,6 +33,7 @@ import datetime
 import os.path
 import logging
 import shlex
+import time
 import sys
 import os
 
@@ -245,51 +248,207 @@ def set_map_subtitles():
 # ====================================================================
 
 def next_frame(func):
+    """Makes calls to the function run on the main thread at the start of the next
+    frame instead. Safe to use from any thread.
+
+    """
     def f(*args, **kwargs):
-        minqlx.next_frame_tasks.append((func, args, kwargs))
+        minqlx.post_callback(functools.partial(func, *args, **kwargs))
 
     return f
 
-def delay(time):
-    """Delay a function call a certain amount of time.
+def delay(time, game_time=False):
+    """Delay a function call a certain amount of time. By default, the time is
+    real time, like it's always been. Pass game_time=True to have time spent
+    paused or in a timeout not count.
 
     .. note::
         It cannot guarantee you that it will be called right as the timer
-        expires, but unless some plugin is for some reason blocking, then
-        you can expect it to be called practically as soon as it expires.
+        expires, but it will be called on the first frame after it does.
 
     :param func: The function to be called.
     :type func: callable
     :param time: The number of seconds before the function should be called.
     :type time: int
+    :param game_time: Count game time instead of real time.
+    :type game_time: bool
 
     """
     def wrap(func):
         def f(*args, **kwargs):
-            minqlx.frame_tasks.enter(time, 0, func, args, kwargs)
+            return minqlx.add_timer(functools.partial(func, *args, **kwargs), time, wall_clock=not game_time)
         return f
     return wrap
 
 _thread_count = 0
 _thread_name = "minqlxthread"
 
+def _int_cvar(name, default):
+    value = minqlx.get_cvar(name)
+    try:
+        return int(value)
+    except (TypeError, ValueError):
+        return default
+
+class ThreadPool:
+    """The threads behind :func:`thread`. Workers are started as they're needed, up to
+    qlx_threadPoolSize of them, and stop again after a minute without work. At most
+    qlx_threadQueueLimit tasks can wait for a worker. Beyond that, qlx_threadPolicy
+    decides what happens: "reject" drops the task, and "caller" runs it in the thread
+    that submitted it instead, unless that's the main thread.
+
+    Keeps track of queue depth and latency per plugin, which the qlx_threads console
+    command prints.
+
+    """
+    idle_timeout = 60
+
+    def __init__(self):
+        self._lock = threading.Lock()
+        self._work = threading.Condition(self._lock)
+        self._tasks = collections.deque()
+        self._workers = 0
+        self._idle = 0
+        self._stats = {}
+
+    def _plugin_stats(self, owner):
+        if owner not in self._stats:
+            self._stats[owner] = {"queued": 0, "running": 0, "done": 0, "rejected": 0,
+                                  "wait": 0.0, "max_wait": 0.0, "run": 0.0}
+        return self._stats[owner]
+
+    def submit(self, owner, func, args, kwargs):
+        global _thread_count
+        future = concurrent.futures.Future()
+        size = max(1, _int_cvar("qlx_threadPoolSize", 8))
+        limit = _int_cvar("qlx_threadQueueLimit", 200)
+
+        with self._lock:
+            stats = self._plugin_stats(owner)
+            rejected = limit > 0 and len(self._tasks) >= limit
+            if rejected:
+                stats["rejected"] += 1
+            else:
+                self._tasks.append((owner, time.perf_counter(), future, func, args, kwargs))
+                stats["queued"] += 1
+                if len(self._tasks) > self._idle and self._workers < size:
+                    self._workers += 1
+                    name = "pool-{}-{}".format(_thread_count, _thread_name)
+                    threading.Thread(target=self._worker, name=name, daemon=True).start()
+                    _thread_count += 1
+                else:
+                    self._work.notify()
+
+        if rejected:
+            # Running it in the main thread would stall the frame, which is exactly
+            # what the pool is there to prevent, so that's always a rejection.
+            if (minqlx.get_cvar("qlx_threadPolicy") == "caller" and
+                threading.current_thread() is not threading.main_thread()):
+                self._run(owner, time.perf_counter(), future, func, args, kwargs)
+            else:
+                future.set_exception(RuntimeError("The thread pool queue is full."))
+                get_logger().warning("The thread pool queue is full. Dropped {} from {}."
+                    .format(func.__name__, owner))
+
+        return future
+
+    def _worker(self):
+        while True:
+            with self._lock:
+                while not self._tasks:
+                    self._idle += 1
+                    notified = self._work.wait(self.idle_timeout)
+                    self._idle -= 1
+                    if not notified and not self._tasks:
+                        self._workers -= 1
+                        return
+                task = self._tasks.popleft()
+                self._stats[task[0]]["queued"] -= 1
+
+            self._run(*task)
+            # Yielding is cooperative, so this doesn't help while a task runs. Tasks
+            # that take a while have to call yield_to_engine themselves.
+            minqlx.yield_to_engine()
+
+    def _run(self, owner, queued_time, future, func, args, kwargs):
+        start = time.perf_counter()
+        with self._lock:
+            stats = self._plugin_stats(owner)
+            stats["running"] += 1
+            stats["wait"] += start - queued_time
+            stats["max_wait"] = max(stats["max_wait"], start - queued_time)
+
+        try:
+            if future.set_running_or_notify_cancel():
+                future.set_result(minqlx.LEDGER.call(owner, "thread", getattr(func, "__qualname__", repr(func)), func, *args, **kwargs))
+        except Exception as e:
+            future.set_exception(e)
+            log_exception()
+        finally:
+            with self._lock:
+                stats["running"] -= 1
+                stats["done"] += 1
+                stats["run"] += time.perf_counter() - start
+
+    def stats(self):
+        """Returns the number of workers, the number of queued tasks and a copy of the
+        statistics of each plugin.
+
+        """
+        with self._lock:
+            return self._workers, len(self._tasks), {k: dict(v) for k, v in self._stats.items()}
+
+THREAD_POOL = ThreadPool()
+
+class PooledThread:
+    """What :func:`thread` returns for calls that go to the pool, in place of the
+    threading.Thread it used to start for each of them. It has the same name that
+    thread would have had, and :meth:`join` and :meth:`is_alive` go by the task
+    instead, so plugins using those keep working. The task's result is in
+    :attr:`future`.
+
+    """
+    daemon = True
+
+    def __init__(self, name, future):
+        self.name = name
+        self.future = future
+
+    def __repr__(self):
+        return "<PooledThread({}, {})>".format(self.name, "started" if self.is_alive() else "stopped")
+
+    def start(self):
+        raise RuntimeError("threads can only be started once")
+
+    def is_alive(self):
+        return not self.future.done()
+
+    def join(self, timeout=None):
+        concurrent.futures.wait((self.future,), timeout)
+
 def thread(func, force=False):
-    """Starts a thread with the function passed as its target. If a function decorated
-    with this is called within a function also decorated, it will **not** create a second
-    thread unless told to do so with the *force* keyword.
+    """Runs the function in one of minqlx's worker threads instead of blocking the
+    caller. If a function decorated with this is called within a function also decorated,
+    it will **not** go to another thread unless told to do so with the *force* keyword,
+    in which case it gets a brand new thread outside of the pool, like it used to.
 
     :param func: The function to be ran in a thread.
     :type func: callable
     :param force: Force it to create a new thread even if already in one created by this decorator.
     :type force: bool
-    :returns: threading.Thread
+    :returns: PooledThread, which can be used like a threading.Thread, or threading.Thread with *force*.
 
     """
     def f(*args, **kwargs):
+        global _thread_count
         if not force and threading.current_thread().name.endswith(_thread_name):
             func(*args, **kwargs)
+        elif not force:
+            owner = minqlx.plugin_owner(func)
+            name = func.__name__ + "-{}-{}".format(str(_thread_count), _thread_name)
+            _thread_count += 1
+            return PooledThread(name, THREAD_POOL.submit(owner, func, args, kwargs))
         else:
-            global _thread_count
             name = func.__name__ + "-{}-{}".format(str(_thread_count), _thread_name)
             t = threading.Thread(target=func, name=name, args=args, kwargs=kwargs, daemon=True)
             t.start()
@@ -299,6 +458,56 @@ def thread(func, force=False):
 
     return f
 
+def _print_thread_stats(args):
+    workers, queued, stats = THREAD_POOL.stats()
+    lines = ["Thread pool: {} workers, {} queued.".format(workers, queued)]
+    lines.append("{:<24}{:>8}{:>8}{:>8}{:>9}{:>11}{:>11}{:>11}".format(
+        "plugin", "queued", "running", "done", "rejected", "avg wait", "max wait", "avg run"))
+    for owner, s in sorted(stats.items()):
+        started = max(s["done"] + s["running"], 1)
+        lines.append("{:<24}{:>8}{:>8}{:>8}{:>9}{:>9.1f}ms{:>9.1f}ms{:>9.1f}ms".format(
+            owner, s["queued"], s["running"], s["done"], s["rejected"],
+            s["wait"] / started * 1000, s["max_wait"] * 1000, s["run"] / max(s["done"], 1) * 1000))
+    minqlx.console_print("\n".join(lines) + "\n")
+
+def _print_gil_stats(args):
+    stats = minqlx.gil_stats(reset=args.strip() == "reset")
+    frames = max(stats["frames"], 1)
+    lines = ["GIL wait over {} frames: {:.3f}ms per frame on average, {:.3f}ms at most.".format(
+        stats["frames"], stats["frame_wait"] / frames * 1000, stats["max_frame_wait"] * 1000)]
+    lines.append("{:<32}{:>10}{:>13}{:>13}".format("dispatcher", "calls", "avg wait", "max wait"))
+    for name, (calls, wait, max_wait) in sorted(stats["dispatchers"].items(), key=lambda x: -x[1][1]):
+        if calls:
+            lines.append("{:<32}{:>10}{:>11.3f}ms{:>11.3f}ms".format(
+                name, calls, wait / calls * 1000, max_wait * 1000))
+    minqlx.console_print("\n".join(lines) + "\n")
+
+def _apply_switch_interval():
+    try:
+        interval = float(minqlx.get_cvar("qlx_gilSwitchInterval"))
+    except (TypeError, ValueError):
+        return
+    if interval > 0:
+        sys.setswitchinterval(interval / 1000)
+
+def _activate_perf_trampoline():
+    """Has CPython add Python functions to /tmp/perf-<pid>.map if qlx_perfTrampoline
+    is on, so that they show up in perf. Needs Python 3.12 or later.
+
+    """
+    if minqlx.get_cvar("qlx_perfTrampoline") != "1":
+        return
+
+    logger = get_logger()
+    if not hasattr(sys, "activate_stack_trampoline"):
+        logger.warning("qlx_perfTrampoline needs Python 3.12 or later.")
+        return
+
+    try:
+        sys.activate_stack_trampoline("perf")
+    except ValueError as e:
+        logger.warning("Could not activate the perf trampoline: {}".format(e))
+
 # ====================================================================
 #                       CONFIG AND PLUGIN LOADING
 # ====================================================================
@@ -336,6 +545,21 @@ def load_preset_plugins():
         raise(PluginLoadError("Cannot find the plugins directory '{}'."
             .format(os.path.abspath(plugins_path))))
 
+def _start_workers(plugins_path):
+    workers = [w.strip() for w in minqlx.get_cvar("qlx_workers").split(",") if w.strip()]
+    if not workers:
+        return
+    elif not hasattr(minqlx, "start_worker"):
+        get_logger().warning("qlx_workers is set, but workers need Python 3.12 or later.")
+        return
+
+    for worker in workers:
+        try:
+            minqlx.start_worker(worker, worker, plugins_path)
+            get_logger().info("Started worker '{}'.".format(worker))
+        except Exception:
+            log_exception()
+
 def load_plugin(plugin):
     logger = get_logger(None)
     logger.info("Loading plugin '{}'...".format(plugin))
@@ -412,6 +636,27 @@ def initialize_cvars():
     minqlx.set_cvar_once("qlx_commandPrefix", "!")
     minqlx.set_cvar_once("qlx_logs", "2")
     minqlx.set_cvar_once("qlx_logsSize", str(3*10**6)) # 3 MB
+    minqlx.set_cvar_once("qlx_inactivityTime", "0")
+    minqlx.set_cvar_once("qlx_serverCommandPacing", "0")
+    minqlx.set_cvar_once("qlx_coalesceConfigstrings", "0")
+    minqlx.set_cvar_once("qlx_batchEvents", "0")
+    minqlx.set_cvar_once("qlx_slowFrameInterval", "10")
+    minqlx.set_cvar_once("qlx_injectBudget", "100")
+    minqlx.set_cvar_once("qlx_gilYield", "0")
+    minqlx.set_cvar_once("qlx_asyncTimeSlice", "5")
+    minqlx.set_cvar_once("qlx_threadPoolSize", "8")
+    minqlx.set_cvar_once("qlx_threadQueueLimit", "200")
+    minqlx.set_cvar_once("qlx_threadPolicy", "reject")
+    minqlx.set_cvar_once("qlx_gilSwitchInterval", "0")
+    minqlx.set_cvar_once("qlx_workers", "")
+    minqlx.set_cvar_once("qlx_gcMode", "0")
+    minqlx.set_cvar_once("qlx_gcMaxInterval", "900")
+    minqlx.set_cvar_once("qlx_pluginLedger", "0")
+    minqlx.set_cvar_once("qlx_memoryTracking", "0")
+    minqlx.set_cvar_once("qlx_memoryFrames", "16")
+    minqlx.set_cvar_once("qlx_memoryBudget", "0")
+    minqlx.set_cvar_once("qlx_profileRate", "100")
+    minqlx.set_cvar_once("qlx_perfTrampoline", "0")
     # Redis
     minqlx.set_cvar_once("qlx_redisAddress", "127.0.0.1")
     minqlx.set_cvar_once("qlx_redisDatabase", "0")
@@ -432,6 +677,13 @@ def late_init():
 
     """
     minqlx.initialize_cvars()
+    minqlx.register_console_command("qlx_threads", _print_thread_stats)
+    minqlx.register_console_command("qlx_gil", _print_gil_stats)
+    minqlx.register_console_command("qlx_ledger", minqlx.LEDGER.print_report)
+    minqlx.LEDGER.configure()
+    minqlx.configure_async()
+    minqlx.setup_profiler()
+    _apply_switch_interval()
 
     # Set the default database plugins should use.
     # TODO: Make Plugin.database setting generic.
@@ -447,12 +699,18 @@ def late_init():
     logger = get_logger()
     # Set our own exception handler so that we can log them if unhandled.
     sys.excepthook = handle_exception
+    _activate_perf_trampoline()
 
     # Add the plugins path to PATH so that we can load plugins later.
     sys.path.append(os.path.dirname(plugins_path))
 
+    _start_workers(plugins_path)
+
+    minqlx.setup_memory_tracking()
+
     logger.info("Loading preset plugins...")
     load_preset_plugins()
+    minqlx.setup_gc()
 
     if bool(int(minqlx.get_cvar("zmq_stats_enable"))):
         global _stats
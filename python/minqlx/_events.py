@@ -17,6 +17,7 @@
 # along with minqlx. If not, see <http://www.gnu.org/licenses/>.
 
 import minqlx
+import asyncio
 import re
 
 _re_vote = re.compile(r"^(?P<cmd>[^ ]+)(?: \"?(?P<args>.*?)\"?)?$")
@@ -30,7 +31,8 @@ class EventDispatcher:
     to hook into events by registering an event handler.
 
     """
-    no_debug = ("frame", "set_configstring", "stats", "server_command", "death", "kill", "command", "console_print")
+    no_debug = ("frame", "slow_frame", "worker_message", "set_configstring", "stats", "server_command", "death", "kill", "command", "console_print",
+                "console_print_batched", "server_command_batched", "set_configstring_batched")
     need_zmq_stats_enabled = False
 
     def __init__(self):
@@ -78,8 +80,12 @@ class EventDispatcher:
             for plugin in plugins:
                 for handler in plugins[plugin][i]:
                     try:
-                        res = handler(*self.args, **self.kwargs)
-                        if res == minqlx.RET_NONE or res is None:
+                        res = minqlx.LEDGER.call(plugin, "event", self.name, handler, *self.args, **self.kwargs)
+                        if asyncio.iscoroutine(res):
+                            # Runs on the event loop, so it can't affect the event.
+                            minqlx.run_async(res, plugin)
+                            continue
+                        elif res == minqlx.RET_NONE or res is None:
                             continue
                         elif res == minqlx.RET_STOP:
                             return True
@@ -196,16 +202,61 @@ class EventDispatcherManager:
 
         del self._dispatchers[event_name]
 
+class BatchableEventDispatcher(EventDispatcher):
+    """An event that, with qlx_batchEvents on, only goes off as it happens while
+    it's hooked. Otherwise the engine buffers it and it's only seen at the end of
+    the frame, through the event with the same name plus "_batched".
+
+    """
+    def add_hook(self, plugin, handler, priority=minqlx.PRI_NORMAL):
+        super().add_hook(plugin, handler, priority)
+        self.update_sync()
+
+    def remove_hook(self, plugin, handler, priority=minqlx.PRI_NORMAL):
+        super().remove_hook(plugin, handler, priority)
+        self.update_sync()
+
+    def needs_sync(self):
+        return any(handlers for priorities in self.plugins.values() for handlers in priorities)
+
+    def update_sync(self):
+        minqlx.set_event_sync(self.name, self.needs_sync())
+
+class OnDemandEventDispatcher(EventDispatcher):
+    """An event the engine only calls into Python for while it's hooked. The
+    Python handler for it, named by :attr:`handler`, is registered when the
+    first hook is added and unregistered when the last one is removed.
+
+    """
+    handler = ""
+
+    def add_hook(self, plugin, handler, priority=minqlx.PRI_NORMAL):
+        super().add_hook(plugin, handler, priority)
+        self.update_handler()
+
+    def remove_hook(self, plugin, handler, priority=minqlx.PRI_NORMAL):
+        super().remove_hook(plugin, handler, priority)
+        self.update_handler()
+
+    def update_handler(self):
+        hooked = any(handlers for priorities in self.plugins.values() for handlers in priorities)
+        minqlx.register_handler(self.name, getattr(minqlx, self.handler) if hooked else None)
+
 # ====================================================================
 #                          EVENT DISPATCHERS
 # ====================================================================
 
-class ConsolePrintDispatcher(EventDispatcher):
+class ConsolePrintDispatcher(BatchableEventDispatcher):
     """Event that goes off whenever the console prints something, including
     those with :func:`minqlx.console_print`.
 
     """
     name = "console_print"
+    redirecting = False
+
+    def needs_sync(self):
+        # Print redirection needs to see prints as they happen.
+        return self.redirecting or super().needs_sync()
 
     def dispatch(self, text):
         return super().dispatch(text)
@@ -221,6 +272,16 @@ class ConsolePrintDispatcher(EventDispatcher):
         else:
             return super().handle_return(handler, value)
 
+class ConsolePrintBatchedDispatcher(EventDispatcher):
+    """Event that goes off at the end of a frame with qlx_batchEvents on, with
+    a list of everything the console printed during it. Cannot be cancelled.
+
+    """
+    name = "console_print_batched"
+
+    def dispatch(self, texts):
+        return super().dispatch(texts)
+
 class CommandDispatcher(EventDispatcher):
     """Event that goes off when a command is executed. This can be used
     to for instance keep a log of all the commands admins have used.
@@ -261,7 +322,7 @@ class ClientCommandDispatcher(EventDispatcher):
         else:
             return super().handle_return(handler, value)
 
-class ServerCommandDispatcher(EventDispatcher):
+class ServerCommandDispatcher(BatchableEventDispatcher):
     """Event that triggers with any server command sent by the server,
     including :func:`minqlx.send_server_command`. Can be cancelled.
 
@@ -283,6 +344,17 @@ class ServerCommandDispatcher(EventDispatcher):
         else:
             return super().handle_return(handler, value)
 
+class ServerCommandBatchedDispatcher(EventDispatcher):
+    """Event that goes off at the end of a frame with qlx_batchEvents on, with
+    a list of ``(player, cmd)`` tuples of the server commands sent during it.
+    The player is None for commands sent to everyone. Cannot be cancelled.
+
+    """
+    name = "server_command_batched"
+
+    def dispatch(self, commands):
+        return super().dispatch(commands)
+
 class FrameEventDispatcher(EventDispatcher):
     """Event that triggers every frame. Cannot be cancelled.
 
@@ -292,7 +364,31 @@ class FrameEventDispatcher(EventDispatcher):
     def dispatch(self):
         return super().dispatch()
 
-class SetConfigstringDispatcher(EventDispatcher):
+class SlowFrameEventDispatcher(OnDemandEventDispatcher):
+    """Event that triggers every qlx_slowFrameInterval frames. Cannot be cancelled.
+
+    The engine only calls into Python for it while at least one plugin hooks it,
+    so it's the cheaper choice for anything that doesn't need to run every frame.
+
+    """
+    name = "slow_frame"
+    handler = "handle_slow_frame"
+
+    def dispatch(self):
+        return super().dispatch()
+
+class WorkerMessageDispatcher(OnDemandEventDispatcher):
+    """Event that goes off at the start of a frame for each message a worker started
+    with qlx_workers sent with ``_minqlx_worker.send``. Cannot be cancelled.
+
+    """
+    name = "worker_message"
+    handler = "handle_worker_message"
+
+    def dispatch(self, worker, data):
+        return super().dispatch(worker, data)
+
+class SetConfigstringDispatcher(BatchableEventDispatcher):
     """Event that triggers when the server tries to set a configstring. You can
     stop this event and use :func:`minqlx.set_configstring` to modify it, but a
     more elegant way to do it is simply returning the new configstring in
@@ -318,6 +414,17 @@ class SetConfigstringDispatcher(EventDispatcher):
         else:
             return super().handle_return(handler, value)
 
+class SetConfigstringBatchedDispatcher(EventDispatcher):
+    """Event that goes off at the end of a frame with qlx_batchEvents on, with
+    a list of ``(index, value)`` tuples of the configstrings set during it.
+    Cannot be cancelled.
+
+    """
+    name = "set_configstring_batched"
+
+    def dispatch(self, configstrings):
+        return super().dispatch(configstrings)
+
 class ChatEventDispatcher(EventDispatcher):
     """Event that triggers with the "say" command. If the handler cancels it,
     the message will also be cancelled.
@@ -381,13 +488,60 @@ class PlayerDisonnectDispatcher(EventDispatcher):
     def dispatch(self, player, reason):
         return super().dispatch(player, reason)
 
-class PlayerSpawnDispatcher(EventDispatcher):
-    """Event that triggers when a player spawns. Cannot be cancelled."""
+class PlayerSpawnDispatcher(OnDemandEventDispatcher):
+    """Event that triggers when a player spawns. Cannot be cancelled.
+
+    The engine only calls into Python on spawns while at least one plugin hooks
+    this event. Plugins that just hand out the same loadout to everyone should use
+    :func:`minqlx.set_spawn_template` instead, which is applied without Python.
+
+    """
     name = "player_spawn"
+    handler = "handle_player_spawn"
 
     def dispatch(self, player):
         return super().dispatch(player)
 
+class PlayerInactiveDispatcher(EventDispatcher):
+    """Event that triggers once when a player on a team has been inactive for
+    qlx_inactivityTime seconds. Cannot be cancelled.
+
+    """
+    name = "player_inactive"
+
+    def dispatch(self, player, idle_time):
+        return super().dispatch(player, idle_time)
+
+class ZoneEnterDispatcher(EventDispatcher):
+    """Event that triggers when a player enters a zone added with minqlx.add_zone().
+    Cannot be cancelled.
+
+    """
+    name = "zone_enter"
+
+    def dispatch(self, player, zone_id):
+        return super().dispatch(player, zone_id)
+
+class ZoneExitDispatcher(EventDispatcher):
+    """Event that triggers when a player leaves a zone. Dying or going to spectator
+    counts as leaving. Cannot be cancelled.
+
+    """
+    name = "zone_exit"
+
+    def dispatch(self, player, zone_id, inside_time):
+        return super().dispatch(player, zone_id, inside_time)
+
+class ZoneDwellDispatcher(EventDispatcher):
+    """Event that triggers once when a player has stayed in a zone for the
+    zone's dwell time. Cannot be cancelled.
+
+    """
+    name = "zone_dwell"
+
+    def dispatch(self, player, zone_id, inside_time):
+        return super().dispatch(player, zone_id, inside_time)
+
 class StatsDispatcher(EventDispatcher):
     """Event that triggers whenever the server sends stats over ZMQ."""
     name = "stats"
@@ -584,17 +738,26 @@ class KamikazeExplodeDispatcher(EventDispatcher):
 
 EVENT_DISPATCHERS = EventDispatcherManager()
 EVENT_DISPATCHERS.add_dispatcher(ConsolePrintDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(ConsolePrintBatchedDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(CommandDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(ClientCommandDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(ServerCommandDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(ServerCommandBatchedDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(FrameEventDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(SlowFrameEventDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(WorkerMessageDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(SetConfigstringDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(SetConfigstringBatchedDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(ChatEventDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(UnloadDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(PlayerConnectDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(PlayerLoadedDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(PlayerDisonnectDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(PlayerSpawnDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(PlayerInactiveDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(ZoneEnterDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(ZoneExitDispatcher)
+EVENT_DISPATCHERS.add_dispatcher(ZoneDwellDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(KamikazeUseDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(KamikazeExplodeDispatcher)
 EVENT_DISPATCHERS.add_dispatcher(StatsDispatcher)
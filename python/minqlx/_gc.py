@@ -0,0 +1,143 @@
+# minqlx - Extends Quake Live's dedicated server with extra functionality and scripting.
+# Copyright (C) 2015 Mino <mino@minomino.org>
+
+# This file is part of minqlx.
+
+# minqlx is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# minqlx is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with minqlx. If not, see <http://www.gnu.org/licenses/>.
+
+import minqlx
+import threading
+import time
+import gc
+
+# ====================================================================
+#                         GARBAGE COLLECTION
+# ====================================================================
+
+# With qlx_gcMode on, Python never collects the oldest generation by itself, since
+# that's the collection that takes long enough to be noticed if it happens mid-round.
+# Instead, it's collected at points where nobody will notice, and the young
+# generations are collected at the end of each round. Whatever was loaded at startup
+# is frozen so that full collections don't have to go through it every time.
+_SAFE_POINTS = {"round_end": 1, "game_end": 2, "warmup": 2, "new_game": 2}
+_NEVER = 2**31 - 1
+
+_enabled = False
+_overdue_timer = None
+_scheduled = False
+_start = 0.0
+_stats_lock = threading.Lock()
+_stats = {}
+
+def _gc_callback(phase, info):
+    global _start
+    if phase == "start":
+        _start = time.perf_counter()
+        return
+
+    pause = time.perf_counter() - _start
+    key = ("scheduled" if _scheduled else "automatic", info["generation"])
+    with _stats_lock:
+        s = _stats.setdefault(key, [0, 0.0, 0.0, 0])
+        s[0] += 1
+        s[1] += pause
+        s[2] = max(s[2], pause)
+        s[3] += info["collected"]
+
+def _arm_overdue_timer():
+    global _overdue_timer
+    if _overdue_timer is not None:
+        minqlx.cancel_timer(_overdue_timer)
+        _overdue_timer = None
+
+    try:
+        interval = float(minqlx.get_cvar("qlx_gcMaxInterval"))
+    except (TypeError, ValueError):
+        return
+    if interval > 0:
+        _overdue_timer = minqlx.add_timer(lambda: gc_safe_point("overdue"), interval, wall_clock=True)
+
+def setup_gc():
+    """Sets up garbage collection according to qlx_gcMode. Called once plugins
+    have been loaded at startup.
+
+    """
+    global _enabled
+    if _gc_callback not in gc.callbacks:
+        gc.callbacks.append(_gc_callback)
+    minqlx.register_console_command("qlx_gc", _print_gc_stats)
+
+    _enabled = minqlx.get_cvar("qlx_gcMode") == "1"
+    if not _enabled:
+        return
+
+    gc_safe_point("startup")
+    gc.freeze()
+    threshold0, threshold1, _ = gc.get_threshold()
+    gc.set_threshold(threshold0, threshold1, _NEVER)
+
+def gc_safe_point(point):
+    """Tells minqlx that now's a good time to collect garbage. Does nothing unless
+    qlx_gcMode is on.
+
+    :param point: "round_end", "game_end", "warmup" or "new_game". Anything else
+        gets a full collection.
+    :type point: str
+
+    """
+    if not _enabled:
+        return
+
+    _collect(_SAFE_POINTS.get(point, 2))
+
+def _collect(generation):
+    global _scheduled
+    _scheduled = True
+    try:
+        gc.collect(generation)
+    finally:
+        _scheduled = False
+
+    if _enabled and generation == 2:
+        _arm_overdue_timer()
+
+def gc_stats(reset=False):
+    """Returns the number of collections, the total and longest pause in seconds, and
+    the number of objects collected, by whether the collection was scheduled by minqlx
+    or triggered by Python, and by generation.
+
+    :returns: dict of (str, int) tuples to [count, total, max, collected] lists.
+
+    """
+    with _stats_lock:
+        stats = {k: list(v) for k, v in _stats.items()}
+        if reset:
+            _stats.clear()
+    return stats
+
+def _print_gc_stats(args):
+    args = args.strip()
+    if args == "collect":
+        _collect(2)
+        return
+
+    stats = gc_stats(reset=args == "reset")
+    lines = ["Garbage collection is {}. {} objects are frozen.".format(
+        "scheduled" if _enabled else "automatic", gc.get_freeze_count())]
+    lines.append("{:<12}{:>5}{:>8}{:>12}{:>12}{:>12}".format(
+        "kind", "gen", "count", "avg pause", "max pause", "collected"))
+    for (kind, generation), (count, total, longest, collected) in sorted(stats.items()):
+        lines.append("{:<12}{:>5}{:>8}{:>10.2f}ms{:>10.2f}ms{:>12}".format(
+            kind, generation, count, total / count * 1000, longest * 1000, collected))
+    minqlx.console_print("\n".join(lines) + "\n")
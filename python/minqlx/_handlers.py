@@ -50,6 +50,20 @@ def handle_rcon(cmd):
         minqlx.log_exception()
         return True
 
+def handle_console_command(cmd, args):
+    """Console commands added with :func:`minqlx.register_console_command`.
+
+    """
+    try:
+        handler = minqlx.CONSOLE_COMMANDS.get(cmd.lower())
+        if handler is None:
+            return False
+
+        handler(args)
+    except:
+        minqlx.log_exception()
+        return True
+
 def handle_client_command(client_id, cmd):
     """Client commands are commands such as "say", "say_team", "scores",
     "disconnect" and so on. This function parses those and passes it
@@ -189,19 +203,27 @@ def handle_server_command(client_id, cmd):
         return True
 
 # Executing tasks right before a frame, by the main thread, will often be desirable to avoid
-# weird behavior if you were to use threading. This list will act as a task queue.
-# Tasks can be added by simply adding the @minqlx.next_frame decorator to functions.
+# weird behavior if you were to use threading. The @minqlx.next_frame decorator posts them
+# with minqlx.post_callback, but plugins that add to next_frame_tasks directly still work.
 frame_tasks = sched.scheduler()
 next_frame_tasks = collections.deque()
 
 def handle_frame():
-    """This will be called every frame. To allow threads to call stuff from the
-    main thread, tasks can be scheduled using the :func:`minqlx.next_frame` decorator
-    and have it be executed here.
+    """This will be called every frame, right after anything posted from other
+    threads with :func:`minqlx.next_frame` or ``minqlx.post_*`` has been done.
 
     """
 
-    while True:
+    # Tasks added during the last frame. Any that these add will run next frame.
+    for _ in range(len(next_frame_tasks)):
+        func, args, kwargs = next_frame_tasks.popleft()
+        try:
+            minqlx.LEDGER.call_task(func, *args, **kwargs)
+        except:
+            minqlx.log_exception()
+
+    # Delays go through minqlx.add_timer, but plugins can still schedule here directly.
+    while not frame_tasks.empty():
         # This will run all tasks that are currently scheduled.
         # If one of the tasks throw an exception, it'll log it
         # and continue execution of the next tasks if any.
@@ -211,19 +233,46 @@ def handle_frame():
         except:
             minqlx.log_exception()
             continue
+    try:
+        minqlx.step_async_loop()
+    except:
+        minqlx.log_exception()
+
     try:
         minqlx.EVENT_DISPATCHERS["frame"].dispatch()
     except:
         minqlx.log_exception()
         return True
 
+def handle_callbacks(callbacks):
+    """Called with the callbacks of the timers added with :func:`minqlx.add_timer`
+    that went off since the last frame, in the order they were due, and with those
+    posted with :func:`minqlx.post_callback`, in the order they were posted.
+
+    """
+    for callback in callbacks:
+        try:
+            minqlx.LEDGER.call_task(callback)
+        except:
+            minqlx.log_exception()
+
+
+def handle_slow_frame():
+    """Called every qlx_slowFrameInterval frames, but only while the event is hooked."""
     try:
-        while True:
-            func, args, kwargs = next_frame_tasks.popleft()
-            frame_tasks.enter(0, 0, func, args, kwargs)
-    except IndexError:
-        pass
+        minqlx.EVENT_DISPATCHERS["slow_frame"].dispatch()
+    except:
+        minqlx.log_exception()
+        return True
 
+def handle_worker_message(messages):
+    """Called once a frame with a list of ``(worker, data)`` tuples for the messages
+    from workers, but only while the event is hooked."""
+    for worker, data in messages:
+        try:
+            minqlx.EVENT_DISPATCHERS["worker_message"].dispatch(worker, data)
+        except:
+            minqlx.log_exception()
 
 _zmq_warning_issued = False
 _first_game = True
@@ -248,6 +297,9 @@ def handle_new_game(is_restart):
     minqlx.set_map_subtitles()
 
     if not is_restart:
+        minqlx.LEDGER.new_map()
+        minqlx.configure_async()
+        minqlx.memory_new_map()
         try:
             minqlx.EVENT_DISPATCHERS["map"].dispatch(
                 minqlx.get_cvar("mapname"),
@@ -261,6 +313,9 @@ def handle_new_game(is_restart):
     except:
         minqlx.log_exception()
         return True
+    finally:
+        # The map just loaded, so nobody will notice a full collection now.
+        minqlx.gc_safe_point("new_game")
 
 def handle_set_configstring(index, value):
     """Called whenever the server tries to set a configstring. Can return
@@ -302,7 +357,7 @@ def handle_set_configstring(index, value):
                     pass
                     #minqlx.EVENT_DISPATCHERS["game_start"].dispatch()
                 elif old_state == "IN_PROGRESS" and new_state == "PRE_GAME":
-                    pass
+                    minqlx.gc_safe_point("warmup")
                 elif old_state == "COUNT_DOWN" and new_state == "PRE_GAME":
                     pass
                 else:
@@ -401,6 +456,74 @@ def handle_player_spawn(client_id):
         minqlx.log_exception()
         return True
 
+def handle_player_inactive(client_id, idle_time):
+    """Called once when a player on a team hasn't given any input for qlx_inactivityTime seconds.
+
+    :param client_id: The client identifier.
+    :type client_id: int
+    :param idle_time: For how long the player has been inactive, in seconds.
+    :type idle_time: float
+
+    """
+    try:
+        player = minqlx.Player(client_id)
+        return minqlx.EVENT_DISPATCHERS["player_inactive"].dispatch(player, idle_time)
+    except:
+        minqlx.log_exception()
+        return True
+
+def handle_zone_enter(client_id, zone_id):
+    """Called when a player enters a zone added with :func:`minqlx.add_zone`.
+
+    :param client_id: The client identifier.
+    :type client_id: int
+    :param zone_id: The zone identifier returned by add_zone.
+    :type zone_id: int
+
+    """
+    try:
+        player = minqlx.Player(client_id)
+        return minqlx.EVENT_DISPATCHERS["zone_enter"].dispatch(player, zone_id)
+    except:
+        minqlx.log_exception()
+        return True
+
+def handle_zone_exit(client_id, zone_id, inside_time):
+    """Called when a player leaves a zone, dies in it, or goes to spectator while in it.
+
+    :param client_id: The client identifier.
+    :type client_id: int
+    :param zone_id: The zone identifier returned by add_zone.
+    :type zone_id: int
+    :param inside_time: For how long the player was inside, in seconds.
+    :type inside_time: float
+
+    """
+    try:
+        player = minqlx.Player(client_id)
+        return minqlx.EVENT_DISPATCHERS["zone_exit"].dispatch(player, zone_id, inside_time)
+    except:
+        minqlx.log_exception()
+        return True
+
+def handle_zone_dwell(client_id, zone_id, inside_time):
+    """Called once when a player has been inside a zone for its dwell time.
+
+    :param client_id: The client identifier.
+    :type client_id: int
+    :param zone_id: The zone identifier returned by add_zone.
+    :type zone_id: int
+    :param inside_time: For how long the player has been inside, in seconds.
+    :type inside_time: float
+
+    """
+    try:
+        player = minqlx.Player(client_id)
+        return minqlx.EVENT_DISPATCHERS["zone_dwell"].dispatch(player, zone_id, inside_time)
+    except:
+        minqlx.log_exception()
+        return True
+
 def handle_kamikaze_use(client_id):
     """This will be called whenever player uses kamikaze item.
 
@@ -460,6 +583,46 @@ def handle_console_print(text):
 _print_redirection = None
 _print_buffer = ""
 
+def handle_batched_events(events):
+    """Called at the end of every frame with qlx_batchEvents on, with the console prints,
+    server commands and configstrings of that frame. Those that didn't go through their
+    regular handler get the processing here that they would have gotten there.
+
+    """
+    try:
+        prints = []
+        commands = []
+        configstrings = []
+        for event_type, arg, text, dispatched in events:
+            if event_type == minqlx.BATCH_CONSOLE_PRINT:
+                if not dispatched and text:
+                    minqlx.get_logger().debug(text.rstrip("\n"))
+                prints.append(text)
+            elif event_type == minqlx.BATCH_SERVER_COMMAND:
+                try:
+                    player = minqlx.Player(arg) if arg >= 0 else None
+                except minqlx.NonexistentPlayerError:
+                    continue
+
+                if not dispatched:
+                    res = _re_vote_ended.match(text)
+                    if res:
+                        minqlx.EVENT_DISPATCHERS["vote_ended"].dispatch(res.group("result") == "passed")
+                commands.append((player, text))
+            elif event_type == minqlx.BATCH_SET_CONFIGSTRING:
+                # Those handle_set_configstring does anything with are never batched.
+                configstrings.append((arg, text))
+
+        if prints:
+            minqlx.EVENT_DISPATCHERS["console_print_batched"].dispatch(prints)
+        if commands:
+            minqlx.EVENT_DISPATCHERS["server_command_batched"].dispatch(commands)
+        if configstrings:
+            minqlx.EVENT_DISPATCHERS["set_configstring_batched"].dispatch(configstrings)
+    except:
+        minqlx.log_exception()
+        return True
+
 def redirect_print(channel):
     """Redirects print output to a channel. Useful for commands that execute console commands
     and want to redirect the output to the channel instead of letting it go to the console.
@@ -482,11 +645,17 @@ def redirect_print(channel):
         def __enter__(self):
             global _print_redirection
             _print_redirection = self.channel
+            dispatcher = minqlx.EVENT_DISPATCHERS["console_print"]
+            dispatcher.redirecting = True
+            dispatcher.update_sync()
 
         def __exit__(self, exc_type, exc_val, exc_tb):
             global _print_redirection
             self.flush()
             _print_redirection = None
+            dispatcher = minqlx.EVENT_DISPATCHERS["console_print"]
+            dispatcher.redirecting = False
+            dispatcher.update_sync()
 
         def flush(self):
             global _print_buffer
@@ -497,16 +666,25 @@ def redirect_print(channel):
 
 def register_handlers():
     minqlx.register_handler("rcon", handle_rcon)
+    minqlx.register_handler("console_command", handle_console_command)
     minqlx.register_handler("client_command", handle_client_command)
     minqlx.register_handler("server_command", handle_server_command)
     minqlx.register_handler("frame", handle_frame)
+    minqlx.register_handler("timer", handle_callbacks)
+    minqlx.register_handler("queued_callbacks", handle_callbacks)
+    # slow_frame and worker_message are registered by their dispatchers, and only while hooked.
     minqlx.register_handler("new_game", handle_new_game)
     minqlx.register_handler("set_configstring", handle_set_configstring)
     minqlx.register_handler("player_connect", handle_player_connect)
     minqlx.register_handler("player_loaded", handle_player_loaded)
     minqlx.register_handler("player_disconnect", handle_player_disconnect)
-    minqlx.register_handler("player_spawn", handle_player_spawn)
+    # player_spawn is registered by its dispatcher, and only while it's hooked.
+    minqlx.register_handler("player_inactive", handle_player_inactive)
+    minqlx.register_handler("zone_enter", handle_zone_enter)
+    minqlx.register_handler("zone_exit", handle_zone_exit)
+    minqlx.register_handler("zone_dwell", handle_zone_dwell)
     minqlx.register_handler("console_print", handle_console_print)
+    minqlx.register_handler("batched_events", handle_batched_events)
 
     minqlx.register_handler("kamikaze_use", handle_kamikaze_use)
     minqlx.register_handler("kamikaze_explode", handle_kamikaze_explode)
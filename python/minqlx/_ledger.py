@@ -0,0 +1,155 @@
+# minqlx - Extends Quake Live's dedicated server with extra functionality and scripting.
+# Copyright (C) 2015 Mino <mino@minomino.org>
+
+# This file is part of minqlx.
+
+# minqlx is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# minqlx is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with minqlx. If not, see <http://www.gnu.org/licenses/>.
+
+import minqlx
+import functools
+import threading
+import time
+
+# ====================================================================
+#                             PLUGIN LEDGER
+# ====================================================================
+
+def plugin_owner(func):
+    """Returns the name of the plugin a function belongs to, going by the module
+    it was defined in. Functions from minqlx itself belong to "minqlx".
+
+    """
+    while isinstance(func, functools.partial):
+        func = func.func
+    module = getattr(func, "__module__", None) or "?"
+    if module == "minqlx" or module.startswith("minqlx."):
+        return "minqlx"
+    return module.rsplit(".", 1)[-1]
+
+class PluginLedger:
+    """Adds up the wall clock and CPU time spent in each plugin's event handlers,
+    commands, scheduled tasks and thread pool tasks while qlx_pluginLedger is on.
+    The CPU time is that of the thread the code ran in, so time the engine or other
+    threads spend in the meantime isn't counted against the plugin.
+
+    Time is exclusive. A handler that ends up triggering other plugins' hooks,
+    like by sending a message or setting a configstring, isn't charged for the
+    time those take, so the totals add up to the time actually spent.
+
+    Starts over on every map, after logging a summary of the last one. The
+    qlx_ledger console command prints it.
+
+    """
+    def __init__(self):
+        self.enabled = False
+        self._lock = threading.Lock()
+        self._entries = {}
+        self._since = time.time()
+        # Per thread, the wall and CPU time of the calls nested in each call
+        # that's still running, innermost last.
+        self._local = threading.local()
+
+    def configure(self):
+        self.enabled = minqlx.get_cvar("qlx_pluginLedger") == "1"
+
+    def call(self, plugin, kind, name, func, *args, **kwargs):
+        """Calls *func*, adding the time it took to *plugin*'s entry for *kind* and *name*."""
+        if not self.enabled:
+            return func(*args, **kwargs)
+
+        stack = getattr(self._local, "stack", None)
+        if stack is None:
+            stack = self._local.stack = []
+
+        nested = [0.0, 0.0]
+        stack.append(nested)
+        wall = time.perf_counter()
+        cpu = time.thread_time()
+        try:
+            return func(*args, **kwargs)
+        finally:
+            wall = time.perf_counter() - wall
+            cpu = time.thread_time() - cpu
+            stack.pop()
+            if stack:
+                stack[-1][0] += wall
+                stack[-1][1] += cpu
+            self.record(plugin, kind, name, wall - nested[0], cpu - nested[1])
+
+    def call_task(self, func, *args, **kwargs):
+        """Like :meth:`call`, but figures out the plugin and name from the function."""
+        if not self.enabled:
+            return func(*args, **kwargs)
+
+        inner = func
+        while isinstance(inner, functools.partial):
+            inner = inner.func
+        name = getattr(inner, "__qualname__", None) or repr(inner)
+        return self.call(plugin_owner(inner), "task", name, func, *args, **kwargs)
+
+    def record(self, plugin, kind, name, wall, cpu):
+        with self._lock:
+            entry = self._entries.setdefault(plugin, {}).setdefault((kind, name), [0, 0.0, 0.0])
+            entry[0] += 1
+            entry[1] += wall
+            entry[2] += cpu
+
+    def totals(self):
+        """Returns a dict of plugin names to (calls, wall, cpu) tuples, in seconds."""
+        with self._lock:
+            return {plugin: tuple(map(sum, zip(*entries.values())))
+                    for plugin, entries in self._entries.items()}
+
+    def breakdown(self, plugin):
+        """Returns a dict of (kind, name) tuples to (calls, wall, cpu) tuples for a plugin."""
+        with self._lock:
+            return {k: tuple(v) for k, v in self._entries.get(plugin, {}).items()}
+
+    def reset(self):
+        with self._lock:
+            self._entries.clear()
+            self._since = time.time()
+
+    def new_map(self):
+        totals = self.totals()
+        if totals:
+            top = sorted(totals.items(), key=lambda x: -x[1][2])[:10]
+            minqlx.get_logger().info("Plugin CPU time over the last {:.0f} seconds: {}".format(
+                time.time() - self._since,
+                ", ".join("{} {:.3f}s".format(p, t[2]) for p, t in top)))
+        self.reset()
+        self.configure()
+
+    def print_report(self, args):
+        args = args.strip()
+        if args == "reset":
+            self.reset()
+            return
+
+        elapsed = time.time() - self._since
+        lines = ["Plugin time over the last {:.0f} seconds{}:".format(
+            elapsed, "" if self.enabled else " (qlx_pluginLedger is off)")]
+        if args:
+            lines.append("{:<10}{:<32}{:>9}{:>12}{:>12}".format("kind", "name", "calls", "wall", "cpu"))
+            for (kind, name), (calls, wall, cpu) in sorted(self.breakdown(args).items(), key=lambda x: -x[1][2]):
+                lines.append("{:<10}{:<32}{:>9}{:>10.1f}ms{:>10.1f}ms".format(
+                    kind, name[:31], calls, wall * 1000, cpu * 1000))
+        else:
+            lines.append("{:<24}{:>9}{:>12}{:>12}{:>8}".format("plugin", "calls", "wall", "cpu", "cpu %"))
+            for plugin, (calls, wall, cpu) in sorted(self.totals().items(), key=lambda x: -x[1][2]):
+                lines.append("{:<24}{:>9}{:>10.1f}ms{:>10.1f}ms{:>7.2f}%".format(
+                    plugin, calls, wall * 1000, cpu * 1000, cpu / max(elapsed, 1) * 100))
+        minqlx.console_print("\n".join(lines) + "\n")
+
+LEDGER = PluginLedger()
@@ -0,0 +1,172 @@
+# minqlx - Extends Quake Live's dedicated server with extra functionality and scripting.
+# Copyright (C) 2015 Mino <mino@minomino.org>
+
+# This file is part of minqlx.
+
+# minqlx is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# minqlx is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with minqlx. If not, see <http://www.gnu.org/licenses/>.
+
+import minqlx
+import tracemalloc
+import os.path
+
+# ====================================================================
+#                          MEMORY ACCOUNTING
+# ====================================================================
+
+# With qlx_memoryTracking on, tracemalloc records where every Python allocation was
+# made. An allocation belongs to the plugin with the innermost frame in its traceback
+# that's in the plugins directory, so memory a plugin allocates through the standard
+# library or minqlx is still counted against it. Anything else belongs to "other".
+#
+# Between map changes, only the size held by each plugin and by each line in a plugin
+# is kept around, instead of a whole snapshot.
+_previous = {}
+_previous_sites = {}
+
+def _plugin_of(traceback, plugins_path):
+    # tracemalloc tracebacks are oldest call first, so go from the innermost frame out.
+    for frame in reversed(traceback):
+        if frame.filename.startswith(plugins_path):
+            name = os.path.relpath(frame.filename, plugins_path).split(os.sep)[0]
+            return (name[:-3] if name.endswith(".py") else name), frame
+    return "other", None
+
+def _plugins_path():
+    return os.path.abspath(minqlx.get_cvar("qlx_pluginsPath")) + os.sep
+
+def start_memory_tracking():
+    if not tracemalloc.is_tracing():
+        try:
+            frames = max(1, int(minqlx.get_cvar("qlx_memoryFrames")))
+        except (TypeError, ValueError):
+            frames = 16
+        tracemalloc.start(frames)
+
+def stop_memory_tracking():
+    global _previous, _previous_sites
+    tracemalloc.stop()
+    _previous = {}
+    _previous_sites = {}
+
+def _take_snapshot():
+    return tracemalloc.take_snapshot().filter_traces((
+        tracemalloc.Filter(False, tracemalloc.__file__),))
+
+def memory_report():
+    """Returns how much memory allocated by Python each plugin holds on to, and how much
+    that has grown since the last map change. Needs qlx_memoryTracking.
+
+    :returns: dict of plugin names to dicts with "size", "count" and "growth", in bytes.
+    :raises: RuntimeError if memory isn't being tracked.
+
+    """
+    if not tracemalloc.is_tracing():
+        raise RuntimeError("Memory isn't being tracked. Set qlx_memoryTracking to 1 or use qlx_memory start.")
+    return _aggregate(_take_snapshot())[0]
+
+def _aggregate(snapshot):
+    """Returns the report for each plugin and a dict of (plugin, "file:line") tuples to
+    the size allocated there."""
+    plugins_path = _plugins_path()
+    report = {}
+    sites = {}
+    for stat in snapshot.statistics("traceback"):
+        plugin, frame = _plugin_of(stat.traceback, plugins_path)
+        entry = report.setdefault(plugin, {"size": 0, "count": 0, "growth": 0})
+        entry["size"] += stat.size
+        entry["count"] += stat.count
+        if frame:
+            key = (plugin, "{}:{}".format(os.path.relpath(frame.filename, plugins_path), frame.lineno))
+            sites[key] = sites.get(key, 0) + stat.size
+
+    for plugin, entry in report.items():
+        entry["growth"] = entry["size"] - _previous.get(plugin, 0)
+    return report, sites
+
+def _growth_sites(plugin, sites):
+    """Returns the places a plugin's memory grew the most since the last map change."""
+    growth = ((site, size - _previous_sites.get((owner, site), 0))
+              for (owner, site), size in sites.items() if owner == plugin)
+    return sorted((x for x in growth if x[1] > 0), key=lambda x: -x[1])[:10]
+
+def _check_budget(report):
+    try:
+        budget = float(minqlx.get_cvar("qlx_memoryBudget")) * 1024 * 1024
+    except (TypeError, ValueError):
+        return
+    if budget <= 0:
+        return
+
+    for plugin, entry in report.items():
+        if plugin != "other" and entry["size"] > budget:
+            minqlx.get_logger().warning("Plugin {} holds on to {:.1f} MB, which is over the budget of {:.1f} MB."
+                .format(plugin, entry["size"] / 1024 / 1024, budget / 1024 / 1024))
+
+def memory_new_map():
+    """Logs which plugins grew the most since the last map change and warns about those
+    over qlx_memoryBudget. Does nothing unless memory is being tracked. Going through
+    the traces takes a while with a lot of them, so it's done in a thread.
+
+    """
+    if tracemalloc.is_tracing():
+        _summarize_map()
+
+@minqlx.thread
+def _summarize_map():
+    global _previous, _previous_sites
+    report, sites = _aggregate(_take_snapshot())
+    if _previous:
+        growth = sorted(((p, e["growth"]) for p, e in report.items() if e["growth"] > 0), key=lambda x: -x[1])
+        if growth:
+            minqlx.get_logger().info("Memory growth since the last map: {}".format(
+                ", ".join("{} {:+.1f} KB".format(p, g / 1024) for p, g in growth[:10])))
+    _check_budget(report)
+
+    _previous = {p: e["size"] for p, e in report.items()}
+    _previous_sites = sites
+
+def _print_memory_report(args):
+    args = args.strip()
+    if args == "start":
+        start_memory_tracking()
+        return
+    elif args == "stop":
+        stop_memory_tracking()
+        return
+    elif not tracemalloc.is_tracing():
+        minqlx.console_print("Memory isn't being tracked. Use qlx_memory start.\n")
+        return
+
+    report, sites = _aggregate(_take_snapshot())
+    if args:
+        lines = ["Biggest growth of {} since the last map change:".format(args)]
+        for site, size in _growth_sites(args, sites):
+            lines.append("{:<48}{:>+12.1f} KB".format(site[-47:], size / 1024))
+    else:
+        current, peak = tracemalloc.get_traced_memory()
+        lines = ["Python is using {:.1f} MB, {:.1f} MB at most.".format(current / 1024 / 1024, peak / 1024 / 1024)]
+        lines.append("{:<24}{:>12}{:>10}{:>12}".format("plugin", "size", "blocks", "growth"))
+        for plugin, e in sorted(report.items(), key=lambda x: -x[1]["size"]):
+            lines.append("{:<24}{:>9.1f} KB{:>10}{:>+9.1f} KB".format(
+                plugin, e["size"] / 1024, e["count"], e["growth"] / 1024))
+    minqlx.console_print("\n".join(lines) + "\n")
+
+def setup_memory_tracking():
+    """Starts tracking memory if qlx_memoryTracking is on. Called before plugins are
+    loaded at startup, so what they allocate while loading is counted too.
+
+    """
+    minqlx.register_console_command("qlx_memory", _print_memory_report)
+    if minqlx.get_cvar("qlx_memoryTracking") == "1":
+        start_memory_tracking()
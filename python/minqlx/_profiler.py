@@ -0,0 +1,163 @@
+# minqlx - Extends Quake Live's dedicated server with extra functionality and scripting.
+# Copyright (C) 2015 Mino <mino@minomino.org>
+
+# This file is part of minqlx.
+
+# minqlx is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# minqlx is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with minqlx. If not, see <http://www.gnu.org/licenses/>.
+
+import minqlx
+import threading
+import time
+import sys
+import os.path
+
+# ====================================================================
+#                          SAMPLING PROFILER
+# ====================================================================
+
+# qlx_profile samples the engine thread from a thread of its own. Each sample is the
+# hooks and dispatchers the engine thread is in, followed by whatever Python code it's
+# running, which is written out as folded stacks for flamegraph.pl and the like.
+#
+# It isn't free for the engine thread. Besides pushing and popping hook names, every
+# sample needs the GIL for sys._current_frames(), so the engine thread can end up
+# waiting for the sampler up to qlx_profileRate times a second, which gil_stats()
+# shows. Samples are also biased: one can't be taken while the engine thread holds
+# the GIL, so they're mostly taken while it's outside Python, and Python code gets
+# sampled at the switch interval at best. Use it to see where Python time goes
+# relative to the hooks, rather than for exact numbers.
+_MAX_DURATION = 300
+
+_profile = None
+_lock = threading.Lock()
+
+class _Profile(threading.Thread):
+    def __init__(self, engine_thread, rate, duration):
+        super().__init__(name="qlx_profile", daemon=True)
+        self.engine_thread = engine_thread
+        self.interval = 1 / rate
+        self.duration = duration
+        self.stopping = threading.Event()
+        self.stacks = {}
+        self.samples = 0
+        self._names = {}
+
+    def run(self):
+        start = time.monotonic()
+        next_sample = start
+        while not self.stopping.is_set() and time.monotonic() - start < self.duration:
+            self.sample()
+            # Don't try to catch up if we fell behind, or we'd just take a burst of samples.
+            next_sample = max(next_sample + self.interval, time.monotonic())
+            self.stopping.wait(next_sample - time.monotonic())
+
+        global _profile
+        with _lock:
+            if _profile is self:
+                _profile = None
+        self.write(time.monotonic() - start)
+
+    def sample(self):
+        hooks = minqlx.hook_stack()
+        frame = sys._current_frames().get(self.engine_thread)
+        frames = []
+        while frame is not None:
+            frames.append(self.frame_name(frame))
+            frame = frame.f_back
+        frames.reverse()
+
+        stack = ";".join(("qzeroded",) + hooks + tuple(frames))
+        self.stacks[stack] = self.stacks.get(stack, 0) + 1
+        self.samples += 1
+
+    def frame_name(self, frame):
+        code = frame.f_code
+        name = self._names.get(code)
+        if name is None:
+            module = frame.f_globals.get("__name__", "?")
+            name = "{}:{}".format(module, getattr(code, "co_qualname", code.co_name)).replace(";", ":")
+            self._names[code] = name
+        return name
+
+    def write(self, elapsed):
+        logger = minqlx.get_logger()
+        path = os.path.join(minqlx.get_cvar("fs_homepath"),
+            "minqlx-profile-{}.folded".format(time.strftime("%Y%m%d-%H%M%S")))
+        try:
+            with open(path, "w") as f:
+                for stack, count in sorted(self.stacks.items()):
+                    f.write("{} {}\n".format(stack, count))
+        except OSError as e:
+            logger.error("Could not write the profile to {}: {}".format(path, e))
+            return
+
+        logger.info("Wrote {} samples over {:.1f} seconds to {}.".format(self.samples, elapsed, path))
+
+def start_profile(duration=30):
+    """Starts sampling what the engine thread is doing at qlx_profileRate samples per
+    second. Stops after *duration* seconds, or 300 at most, and writes the samples to
+    fs_homepath as folded stacks. Has to be called from the engine thread.
+
+    :returns: False if a profile is already being taken, True otherwise.
+
+    """
+    global _profile
+    try:
+        rate = min(max(float(minqlx.get_cvar("qlx_profileRate")), 1), 1000)
+    except (TypeError, ValueError):
+        rate = 100
+
+    with _lock:
+        if _profile is not None:
+            return False
+        _profile = _Profile(threading.get_ident(), rate, min(max(duration, 1), _MAX_DURATION))
+        _profile.start()
+        return True
+
+def stop_profile():
+    """Stops the profile being taken, if any, which then gets written out.
+
+    :returns: False if no profile was being taken, True otherwise.
+
+    """
+    with _lock:
+        if _profile is None:
+            return False
+        _profile.stopping.set()
+        return True
+
+def _handle_profile_command(args):
+    args = args.split()
+    if args and args[0] == "start":
+        try:
+            duration = float(args[1]) if len(args) > 1 else 30
+        except ValueError:
+            minqlx.console_print("Usage: qlx_profile start [seconds]\n")
+            return
+        if start_profile(duration):
+            minqlx.console_print("Profiling for {:.0f} seconds.\n".format(min(max(duration, 1), _MAX_DURATION)))
+        else:
+            minqlx.console_print("A profile is already being taken.\n")
+    elif args and args[0] == "stop":
+        if not stop_profile():
+            minqlx.console_print("No profile is being taken.\n")
+    else:
+        profile = _profile
+        if profile:
+            minqlx.console_print("Profiling. {} samples so far.\n".format(profile.samples))
+        else:
+            minqlx.console_print("Usage: qlx_profile start [seconds] | stop\n")
+
+def setup_profiler():
+    minqlx.register_console_command("qlx_profile", _handle_profile_command)
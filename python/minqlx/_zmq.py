@@ -68,6 +68,7 @@ class StatsListener():
                     minqlx.EVENT_DISPATCHERS["game_start"].dispatch(stats["DATA"])
                 elif stats["TYPE"] == "ROUND_OVER":
                     minqlx.EVENT_DISPATCHERS["round_end"].dispatch(stats["DATA"])
+                    minqlx.gc_safe_point("round_end")
                 elif stats["TYPE"] == "MATCH_REPORT":
                     # MATCH_REPORT event goes off with a map change and map_restart,
                     # but we really only want it for when the game actually ends.
@@ -75,6 +76,7 @@ class StatsListener():
                     # time we get the event, the game is probably gone.
                     if self._in_progress:
                         minqlx.EVENT_DISPATCHERS["game_end"].dispatch(stats["DATA"])
+                        minqlx.gc_safe_point("game_end")
                     self._in_progress = False
                 elif stats["TYPE"] == "PLAYER_DEATH":
                     # Dead player.
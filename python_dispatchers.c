@@ -1,17 +1,85 @@
 #include <Python.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "pyminqlx.h"
 #include "quake_common.h"
 
-int allow_free_client = -1;
+// Thread-local, like the buffers dispatchers return, since without a GIL
+// hooks can go off in several threads at once.
+__thread int allow_free_client = -1;
+__thread int on_engine_thread;
+
+gilStats_t* gil_stats;
+pthread_mutex_t gil_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+uint64_t frame_gil_wait_ns;
+uint64_t max_frame_gil_wait_ns;
+uint64_t total_frame_gil_wait_ns;
+uint64_t gil_frames;
+int engine_wants_gil;
+const char* hook_stack[MAX_HOOK_DEPTH];
+int hook_depth;
+
+static uint64_t MonotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+PyGILState_STATE EngineGILEnsure(gilStats_t* stats) {
+    // Plugin threads get here too, through send_server_command making the engine
+    // print and the like. Their waits aren't the engine's, and other threads
+    // shouldn't yield to them.
+    if (!on_engine_thread)
+        return PyGILState_Ensure();
+
+    uint64_t start = MonotonicNs();
+    __atomic_add_fetch(&engine_wants_gil, 1, __ATOMIC_RELEASE);
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    __atomic_sub_fetch(&engine_wants_gil, 1, __ATOMIC_RELEASE);
+    uint64_t wait = MonotonicNs() - start;
+
+    pthread_mutex_lock(&gil_stats_lock);
+    if (!stats->listed) {
+        stats->next = gil_stats;
+        gil_stats = stats;
+        stats->listed = 1;
+    }
+
+    stats->calls++;
+    stats->wait_ns += wait;
+    if (wait > stats->max_wait_ns)
+        stats->max_wait_ns = wait;
+    frame_gil_wait_ns += wait;
+    pthread_mutex_unlock(&gil_stats_lock);
+
+    HookEnter(stats->name);
+    return gstate;
+}
+
+void EngineGILRelease(PyGILState_STATE gstate) {
+    HookLeave();
+    PyGILState_Release(gstate);
+}
+
+// Called at the end of every frame.
+void GILFrameDone(void) {
+    pthread_mutex_lock(&gil_stats_lock);
+    gil_frames++;
+    total_frame_gil_wait_ns += frame_gil_wait_ns;
+    if (frame_gil_wait_ns > max_frame_gil_wait_ns)
+        max_frame_gil_wait_ns = frame_gil_wait_ns;
+    frame_gil_wait_ns = 0;
+    pthread_mutex_unlock(&gil_stats_lock);
+}
 
 char* ClientCommandDispatcher(int client_id, char* cmd) {
     char* ret = cmd;
-    static char ccmd_buf[4096];
+    static __thread char ccmd_buf[4096];
     if (!client_command_handler)
         return ret; // No registered handler.
     
-    PyGILState_STATE gstate = PyGILState_Ensure();
+    ENGINE_GIL_ENSURE(gstate);
 
     PyObject* cmd_string = PyUnicode_DecodeUTF8(cmd, strlen(cmd), "ignore");
     PyObject* result = PyObject_CallFunction(client_command_handler, "iO", client_id, cmd_string);
@@ -29,17 +97,19 @@ char* ClientCommandDispatcher(int client_id, char* cmd) {
     Py_XDECREF(cmd_string);
     Py_XDECREF(result);
 
-    PyGILState_Release(gstate);
+    EngineGILRelease(gstate);
     return ret;
 }
 
 char* ServerCommandDispatcher(int client_id, char* cmd) {
     char* ret = cmd;
-    static char scmd_buf[4096];
+    static __thread char scmd_buf[4096];
     if (!server_command_handler)
         return ret; // No registered handler.
+    else if (DeferEvent(BATCH_SERVER_COMMAND, client_id, cmd))
+        return ret; // Goes to Python at the end of the frame instead.
 
-    PyGILState_STATE gstate = PyGILState_Ensure();
+    ENGINE_GIL_ENSURE(gstate);
 
     PyObject* cmd_string = PyUnicode_DecodeUTF8(cmd, strlen(cmd), "ignore");
     PyObject* result = PyObject_CallFunction(server_command_handler, "iO", client_id, cmd_string);
@@ -57,7 +127,10 @@ char* ServerCommandDispatcher(int client_id, char* cmd) {
     Py_XDECREF(cmd_string);
     Py_XDECREF(result);
 
-    PyGILState_Release(gstate);
+    EngineGILRelease(gstate);
+
+    if (ret)
+        RecordEvent(BATCH_SERVER_COMMAND, client_id, ret);
     return ret;
 }
 
@@ -65,23 +138,77 @@ void FrameDispatcher(void) {
     if (!frame_handler)
         return; // No registered handler.
 
-    PyGILState_STATE gstate = PyGILState_Ensure();
+    ENGINE_GIL_ENSURE(gstate);
 
     PyObject* result = PyObject_CallObject(frame_handler, NULL);
 
     Py_XDECREF(result);
 
-    PyGILState_Release(gstate);
+    EngineGILRelease(gstate);
     return;
 }
 
+void SlowFrameDispatcher(void) {
+    if (!slow_frame_handler)
+        return; // No registered handler.
+
+    ENGINE_GIL_ENSURE(gstate);
+
+    PyObject* result = PyObject_CallObject(slow_frame_handler, NULL);
+
+    if (result == NULL)
+        DebugError("PyObject_CallObject() returned NULL.\n",
+                __FILE__, __LINE__, __func__);
+    Py_XDECREF(result);
+
+    EngineGILRelease(gstate);
+}
+
+// Hands a list of callables to handler. Takes over the references to them, so
+// unlike the other dispatchers it has to go through with it even if there's no handler.
+static void CallbackDispatcher(PyObject* handler, void** callbacks, int count, gilStats_t* stats) {
+    PyGILState_STATE gstate = EngineGILEnsure(stats);
+
+    PyObject* callback_list = PyList_New(count);
+    for (int i = 0; i < count; i++) {
+        if (callback_list)
+            PyList_SET_ITEM(callback_list, i, (PyObject*)callbacks[i]);
+        else
+            Py_DECREF((PyObject*)callbacks[i]);
+    }
+
+    if (callback_list && handler) {
+        PyObject* result = PyObject_CallFunction(handler, "O", callback_list);
+
+        if (result == NULL)
+            DebugError("PyObject_CallFunction() returned NULL.\n",
+                    __FILE__, __LINE__, __func__);
+        Py_XDECREF(result);
+    }
+    else if (!callback_list)
+        PyErr_Clear();
+    Py_XDECREF(callback_list);
+
+    EngineGILRelease(gstate);
+}
+
+void TimerDispatcher(void** callbacks, int count) {
+    static gilStats_t stats = {"TimerDispatcher"};
+    CallbackDispatcher(timer_handler, callbacks, count, &stats);
+}
+
+void QueuedCallbackDispatcher(void** callbacks, int count) {
+    static gilStats_t stats = {"QueuedCallbackDispatcher"};
+    CallbackDispatcher(queued_callbacks_handler, callbacks, count, &stats);
+}
+
 char* ClientConnectDispatcher(int client_id, int is_bot) {
 	char* ret = NULL;
-    static char connect_buf[4096];
+    static __thread char connect_buf[4096];
 	if (!client_connect_handler)
 		return ret; // No registered handler.
 
-	PyGILState_STATE gstate = PyGILState_Ensure();
+	ENGINE_GIL_ENSURE(gstate);
 
 	// Tell PyMinqlx_PlayerInfo it's OK to get player info for someone with CS_FREE.
 	allow_free_client = client_id;
@@ -100,7 +227,7 @@ char* ClientConnectDispatcher(int client_id, int is_bot) {
 
 	Py_XDECREF(result);
 
-	PyGILState_Release(gstate);
+	EngineGILRelease(gstate);
 	return ret;
 }
 
@@ -108,7 +235,7 @@ void ClientDisconnectDispatcher(int client_id, const char* reason) {
 	if (!client_disconnect_handler)
 		return; // No registered handler.
 
-	PyGILState_STATE gstate = PyGILState_Ensure();
+	ENGINE_GIL_ENSURE(gstate);
 
     // Tell PyMinqlx_PlayerInfo it's OK to get player info for someone with CS_FREE.
     allow_free_client = client_id;
@@ -121,7 +248,7 @@ void ClientDisconnectDispatcher(int client_id, const char* reason) {
 
 	Py_XDECREF(result);
 
-	PyGILState_Release(gstate);
+	EngineGILRelease(gstate);
 	return;
 }
 
@@ -131,7 +258,7 @@ int ClientLoadedDispatcher(int client_id) {
 	if (!client_loaded_handler)
 		return ret; // No registered handler.
 
-	PyGILState_STATE gstate = PyGILState_Ensure();
+	ENGINE_GIL_ENSURE(gstate);
 
 	PyObject* result = PyObject_CallFunction(client_loaded_handler, "i", client_id);
 
@@ -139,7 +266,7 @@ int ClientLoadedDispatcher(int client_id) {
 	if (result == NULL) {
 		DebugError("PyObject_CallFunction() returned NULL.\n",
 				__FILE__, __LINE__, __func__);
-		PyGILState_Release(gstate);
+		EngineGILRelease(gstate);
 		return ret;
 	}
 	else if (PyBool_Check(result) && result == Py_False) {
@@ -148,7 +275,7 @@ int ClientLoadedDispatcher(int client_id) {
 
 	Py_XDECREF(result);
 
-	PyGILState_Release(gstate);
+	EngineGILRelease(gstate);
 	return ret;
 }
 
@@ -156,7 +283,7 @@ void NewGameDispatcher(int restart) {
 	if (!new_game_handler)
 		return; // No registered handler.
 
-	PyGILState_STATE gstate = PyGILState_Ensure();
+	ENGINE_GIL_ENSURE(gstate);
 
 	PyObject* result = PyObject_CallFunction(new_game_handler, "O", restart ? Py_True : Py_False);
 
@@ -165,17 +292,19 @@ void NewGameDispatcher(int restart) {
 
 	Py_XDECREF(result);
 
-	PyGILState_Release(gstate);
+	EngineGILRelease(gstate);
 	return;
 }
 
 char* SetConfigstringDispatcher(int index, char* value) {
 	char* ret = value;
-    static char setcs_buf[4096];
+    static __thread char setcs_buf[4096];
 	if (!set_configstring_handler)
 		return ret; // No registered handler.
+	else if (DeferEvent(BATCH_SET_CONFIGSTRING, index, value))
+		return ret; // Goes to Python at the end of the frame instead.
 
-	PyGILState_STATE gstate = PyGILState_Ensure();
+	ENGINE_GIL_ENSURE(gstate);
 
     PyObject* value_string = PyUnicode_DecodeUTF8(value, strlen(value), "ignore");
 	PyObject* result = PyObject_CallFunction(set_configstring_handler, "iO", index, value_string);
@@ -193,7 +322,10 @@ char* SetConfigstringDispatcher(int index, char* value) {
     Py_XDECREF(value_string);
 	Py_XDECREF(result);
 
-	PyGILState_Release(gstate);
+	EngineGILRelease(gstate);
+
+	if (ret)
+		RecordEvent(BATCH_SET_CONFIGSTRING, index, ret);
 	return ret;
 }
 
@@ -201,7 +333,7 @@ void RconDispatcher(const char* cmd) {
     if (!rcon_handler)
         return; // No registered handler.
 
-    PyGILState_STATE gstate = PyGILState_Ensure();
+    ENGINE_GIL_ENSURE(gstate);
 
     PyObject* result = PyObject_CallFunction(rcon_handler, "s", cmd);
 
@@ -210,16 +342,18 @@ void RconDispatcher(const char* cmd) {
                 __FILE__, __LINE__, __func__);
     Py_XDECREF(result);
 
-    PyGILState_Release(gstate);
+    EngineGILRelease(gstate);
 }
 
 char* ConsolePrintDispatcher(char* text) {
     char* ret = text;
-    static char print_buf[4096];
+    static __thread char print_buf[4096];
     if (!console_print_handler)
         return ret; // No registered handler.
+    else if (DeferEvent(BATCH_CONSOLE_PRINT, 0, text))
+        return ret; // Goes to Python at the end of the frame instead.
 
-    PyGILState_STATE gstate = PyGILState_Ensure();
+    ENGINE_GIL_ENSURE(gstate);
 
     PyObject* text_string = PyUnicode_DecodeUTF8(text, strlen(text), "ignore");
     PyObject* result = PyObject_CallFunction(console_print_handler, "O", text_string);
@@ -237,7 +371,10 @@ char* ConsolePrintDispatcher(char* text) {
     Py_XDECREF(text_string);
     Py_XDECREF(result);
 
-    PyGILState_Release(gstate);
+    EngineGILRelease(gstate);
+
+    if (ret)
+        RecordEvent(BATCH_CONSOLE_PRINT, 0, ret);
     return ret;
 }
 
@@ -245,7 +382,7 @@ void ClientSpawnDispatcher(int client_id) {
     if (!client_spawn_handler)
         return; // No registered handler.
 
-    PyGILState_STATE gstate = PyGILState_Ensure();
+    ENGINE_GIL_ENSURE(gstate);
 
     PyObject* result = PyObject_CallFunction(client_spawn_handler, "i", client_id);
 
@@ -256,14 +393,162 @@ void ClientSpawnDispatcher(int client_id) {
     }
     Py_XDECREF(result);
 
-    PyGILState_Release(gstate);
+    EngineGILRelease(gstate);
+}
+
+// idle_time is in milliseconds of level time.
+void PlayerInactiveDispatcher(int client_id, int idle_time) {
+    if (!player_inactive_handler)
+        return; // No registered handler.
+
+    ENGINE_GIL_ENSURE(gstate);
+
+    PyObject* result = PyObject_CallFunction(player_inactive_handler, "if", client_id, idle_time / 1000.0f);
+
+    if (result == NULL) {
+        DebugError("PyObject_CallFunction() returned NULL.\n",
+                __FILE__, __LINE__, __func__);
+    }
+    Py_XDECREF(result);
+
+    EngineGILRelease(gstate);
+}
+
+void ZoneEnterDispatcher(int client_id, int zone_id) {
+    if (!zone_enter_handler)
+        return; // No registered handler.
+
+    ENGINE_GIL_ENSURE(gstate);
+
+    PyObject* result = PyObject_CallFunction(zone_enter_handler, "ii", client_id, zone_id);
+
+    if (result == NULL) {
+        DebugError("PyObject_CallFunction() returned NULL.\n",
+                __FILE__, __LINE__, __func__);
+    }
+    Py_XDECREF(result);
+
+    EngineGILRelease(gstate);
+}
+
+// inside_time is in milliseconds of level time.
+void ZoneExitDispatcher(int client_id, int zone_id, int inside_time) {
+    if (!zone_exit_handler)
+        return; // No registered handler.
+
+    ENGINE_GIL_ENSURE(gstate);
+
+    PyObject* result = PyObject_CallFunction(zone_exit_handler, "iif", client_id, zone_id, inside_time / 1000.0f);
+
+    if (result == NULL) {
+        DebugError("PyObject_CallFunction() returned NULL.\n",
+                __FILE__, __LINE__, __func__);
+    }
+    Py_XDECREF(result);
+
+    EngineGILRelease(gstate);
+}
+
+// inside_time is in milliseconds of level time.
+void ZoneDwellDispatcher(int client_id, int zone_id, int inside_time) {
+    if (!zone_dwell_handler)
+        return; // No registered handler.
+
+    ENGINE_GIL_ENSURE(gstate);
+
+    PyObject* result = PyObject_CallFunction(zone_dwell_handler, "iif", client_id, zone_id, inside_time / 1000.0f);
+
+    if (result == NULL) {
+        DebugError("PyObject_CallFunction() returned NULL.\n",
+                __FILE__, __LINE__, __func__);
+    }
+    Py_XDECREF(result);
+
+    EngineGILRelease(gstate);
+}
+
+void WorkerMessageDispatcher(const workerMessage_t* messages, int count) {
+    if (!worker_message_handler)
+        return; // No registered handler.
+
+    ENGINE_GIL_ENSURE(gstate);
+
+    PyObject* message_list = PyList_New(count);
+    const workerMessage_t* m = messages;
+    for (int i = 0; message_list && i < count; i++, m = m->next) {
+        PyObject* data = PyBytes_FromStringAndSize(m->data, m->len);
+        PyObject* item = data ? Py_BuildValue("(sN)", m->worker, data) : NULL;
+        if (!item) {
+            Py_CLEAR(message_list);
+            break;
+        }
+        PyList_SET_ITEM(message_list, i, item);
+    }
+
+    if (!message_list) {
+        DebugError("Failed to build the list of worker messages.\n",
+                __FILE__, __LINE__, __func__);
+        PyErr_Clear();
+        EngineGILRelease(gstate);
+        return;
+    }
+
+    PyObject* result = PyObject_CallFunction(worker_message_handler, "O", message_list);
+
+    if (result == NULL) {
+        DebugError("PyObject_CallFunction() returned NULL.\n",
+                __FILE__, __LINE__, __func__);
+    }
+    Py_DECREF(message_list);
+    Py_XDECREF(result);
+
+    EngineGILRelease(gstate);
+}
+
+void BatchedEventsDispatcher(const batchedEvent_t** events, int count) {
+    if (!batched_events_handler)
+        return; // No registered handler.
+
+    ENGINE_GIL_ENSURE(gstate);
+
+    PyObject* event_list = PyList_New(count);
+    for (int i = 0; event_list && i < count; i++) {
+        const batchedEvent_t* e = events[i];
+        PyObject* text = PyUnicode_DecodeUTF8(e->text, e->len, "ignore");
+        PyObject* item = text ? Py_BuildValue("(iiNO)", e->type, e->arg, text,
+                                              e->dispatched ? Py_True : Py_False) : NULL;
+        if (!item) {
+            Py_CLEAR(event_list);
+            break;
+        }
+        PyList_SET_ITEM(event_list, i, item);
+    }
+
+    if (!event_list) {
+        DebugError("Failed to build the list of batched events.\n",
+                __FILE__, __LINE__, __func__);
+        PyErr_Clear();
+        EngineGILRelease(gstate);
+        return;
+    }
+
+    PyObject* result = PyObject_CallFunction(batched_events_handler, "O", event_list);
+
+    if (result == NULL) {
+        DebugError("PyObject_CallFunction() returned NULL.\n",
+                __FILE__, __LINE__, __func__);
+    }
+    Py_DECREF(event_list);
+    Py_XDECREF(result);
+
+    EngineGILRelease(gstate);
 }
 
 void KamikazeUseDispatcher(int client_id) {
     if (!kamikaze_use_handler)
         return; // No registered handler.
 
-    PyGILState_STATE gstate = PyGILState_Ensure();
+    ENGINE_GIL_ENSURE(gstate);
 
     PyObject* result = PyObject_CallFunction(kamikaze_use_handler, "i", client_id);
 
@@ -274,14 +559,14 @@ void KamikazeUseDispatcher(int client_id) {
     }
     Py_XDECREF(result);
 
-    PyGILState_Release(gstate);
+    EngineGILRelease(gstate);
 }
 
 void KamikazeExplodeDispatcher(int client_id, int is_used_on_demand) {
     if (!kamikaze_explode_handler)
         return; // No registered handler.
 
-    PyGILState_STATE gstate = PyGILState_Ensure();
+    ENGINE_GIL_ENSURE(gstate);
 
     PyObject* result = PyObject_CallFunction(kamikaze_explode_handler, "ii", client_id, is_used_on_demand);
 
@@ -292,5 +577,5 @@ void KamikazeExplodeDispatcher(int client_id, int is_used_on_demand) {
     }
     Py_XDECREF(result);
 
-    PyGILState_Release(gstate);
+    EngineGILRelease(gstate);
 }
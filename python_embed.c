@@ -5,11 +5,20 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "pyminqlx.h"
 #include "quake_common.h"
 #include "patterns.h"
 #include "common.h"
+#include "client_input.h"
+#include "zones.h"
+#include "spatial_index.h"
+#include "entity_index.h"
+#include "command_queue.h"
+#include "timers.h"
+#include "inject_queue.h"
+#include "subinterpreters.h"
 
 PyObject* client_command_handler = NULL;
 PyObject* server_command_handler = NULL;
@@ -17,12 +26,22 @@ PyObject* client_connect_handler = NULL;
 PyObject* client_loaded_handler = NULL;
 PyObject* client_disconnect_handler = NULL;
 PyObject* frame_handler = NULL;
+PyObject* slow_frame_handler = NULL;
+PyObject* timer_handler = NULL;
+PyObject* queued_callbacks_handler = NULL;
 PyObject* custom_command_handler = NULL;
+PyObject* console_command_handler = NULL;
 PyObject* new_game_handler = NULL;
 PyObject* set_configstring_handler = NULL;
 PyObject* rcon_handler = NULL;
 PyObject* console_print_handler = NULL;
 PyObject* client_spawn_handler = NULL;
+PyObject* player_inactive_handler = NULL;
+PyObject* zone_enter_handler = NULL;
+PyObject* zone_exit_handler = NULL;
+PyObject* zone_dwell_handler = NULL;
+PyObject* batched_events_handler = NULL;
+PyObject* worker_message_handler = NULL;
 
 PyObject* kamikaze_use_handler = NULL;
 PyObject* kamikaze_explode_handler = NULL;
@@ -58,15 +77,25 @@ static handler_t handlers[] = {
 		{"client_command", 		&client_command_handler},
 		{"server_command", 		&server_command_handler},
 		{"frame", 				&frame_handler},
+		{"slow_frame", 			&slow_frame_handler},
+		{"timer", 				&timer_handler},
+		{"queued_callbacks", 	&queued_callbacks_handler},
 		{"player_connect", 		&client_connect_handler},
 		{"player_loaded", 		&client_loaded_handler},
 		{"player_disconnect", 	&client_disconnect_handler},
 		{"custom_command", 		&custom_command_handler},
+        {"console_command",     &console_command_handler},
 		{"new_game",			&new_game_handler},
 		{"set_configstring", 	&set_configstring_handler},
         {"rcon",                &rcon_handler},
         {"console_print",       &console_print_handler},
         {"player_spawn",        &client_spawn_handler},
+        {"player_inactive",     &player_inactive_handler},
+        {"zone_enter",          &zone_enter_handler},
+        {"zone_exit",           &zone_exit_handler},
+        {"zone_dwell",          &zone_dwell_handler},
+        {"batched_events",      &batched_events_handler},
+        {"worker_message",      &worker_message_handler},
 
         {"kamikaze_use",        &kamikaze_use_handler},
         {"kamikaze_explode",    &kamikaze_explode_handler},
@@ -350,7 +379,7 @@ static PyObject* PyMinqlx_SendServerCommand(PyObject* self, PyObject* args) {
     else if (PyLong_Check(client_id)) {
         i = PyLong_AsLong(client_id);
         if (i >= 0 && i < sv_maxclients->integer) {
-            if (svs->clients[i].state != CS_ACTIVE)
+            if (svs->clients[i].state != CS_ACTIVE || CommandQueueFull(i))
                 Py_RETURN_FALSE;
             else {
                 My_SV_SendServerCommand(&svs->clients[i], "%s\n", cmd);
@@ -539,7 +568,7 @@ static PyObject* PyMinqlx_GetConfigstring(PyObject* self, PyObject* args) {
 		return NULL;
 	}
 
-    SV_GetConfigstring(i, csbuffer, sizeof(csbuffer));
+    My_SV_GetConfigstring(i, csbuffer, sizeof(csbuffer));
     return PyUnicode_DecodeUTF8(csbuffer, strlen(csbuffer), "ignore");
 }
 
@@ -612,6 +641,22 @@ static PyObject* PyMinqlx_AddConsoleCommand(PyObject* self, PyObject* args) {
     Py_RETURN_NONE;
 }
 
+/*
+ * ================================================================
+ *                     add_named_console_command
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_AddNamedConsoleCommand(PyObject* self, PyObject* args) {
+    char* cmd;
+    if (!PyArg_ParseTuple(args, "s:add_named_console_command", &cmd))
+        return NULL;
+
+    Cmd_AddCommand(cmd, PyConsoleCommand);
+
+    Py_RETURN_NONE;
+}
+
 /*
  * ================================================================
  *                         register_handler
@@ -894,6 +939,227 @@ static PyObject* PyMinqlx_NoClip(PyObject* self, PyObject* args) {
     Py_RETURN_TRUE;
 }
 
+/*
+* ================================================================
+*                      player state helpers
+* ================================================================
+*/
+
+/* These are shared by the individual setters and apply_player_state. The
+ * *_from_pyobject functions take any sequence with one item per field of
+ * the corresponding struct sequence and return -1 with an exception set
+ * if something's wrong with it. */
+
+static int weapons_from_pyobject(PyObject* weapons, int* weapon_flags) {
+    PyObject* seq = PySequence_Fast(weapons, "Weapons must be a sequence.");
+    if (!seq)
+        return -1;
+    else if (PySequence_Fast_GET_SIZE(seq) != weapons_desc.n_in_sequence) {
+        PyErr_Format(PyExc_ValueError, "Weapons must have %d items.", weapons_desc.n_in_sequence);
+        Py_DECREF(seq);
+        return -1;
+    }
+
+    *weapon_flags = 0;
+    for (int i = 0; i < weapons_desc.n_in_sequence; i++) {
+        PyObject* w = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyBool_Check(w)) {
+            PyErr_Format(PyExc_ValueError, "Tuple argument %d is not a boolean.", i);
+            Py_DECREF(seq);
+            return -1;
+        }
+
+        *weapon_flags |= w == Py_True ? (1 << (i+1)) : 0;
+    }
+
+    Py_DECREF(seq);
+    return 0;
+}
+
+static int ammo_from_pyobject(PyObject* ammos, int* ammo) {
+    PyObject* seq = PySequence_Fast(ammos, "Ammo must be a sequence.");
+    if (!seq)
+        return -1;
+    else if (PySequence_Fast_GET_SIZE(seq) != weapons_desc.n_in_sequence) {
+        PyErr_Format(PyExc_ValueError, "Ammo must have %d items.", weapons_desc.n_in_sequence);
+        Py_DECREF(seq);
+        return -1;
+    }
+
+    for (int i = 0; i < weapons_desc.n_in_sequence; i++) {
+        PyObject* a = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyLong_Check(a)) {
+            PyErr_Format(PyExc_ValueError, "Tuple argument %d is not an integer.", i);
+            Py_DECREF(seq);
+            return -1;
+        }
+
+        ammo[i] = PyLong_AsLong(a);
+    }
+
+    Py_DECREF(seq);
+    return 0;
+}
+
+static int powerups_from_pyobject(PyObject* powerups, int* times) {
+    PyObject* seq = PySequence_Fast(powerups, "Powerups must be a sequence.");
+    if (!seq)
+        return -1;
+    else if (PySequence_Fast_GET_SIZE(seq) != powerups_desc.n_in_sequence) {
+        PyErr_Format(PyExc_ValueError, "Powerups must have %d items.", powerups_desc.n_in_sequence);
+        Py_DECREF(seq);
+        return -1;
+    }
+
+    for (int i = 0; i < powerups_desc.n_in_sequence; i++) {
+        PyObject* powerup = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyLong_Check(powerup)) {
+            PyErr_Format(PyExc_ValueError, "Tuple argument %d is not an integer.", i);
+            Py_DECREF(seq);
+            return -1;
+        }
+
+        times[i] = PyLong_AsLong(powerup);
+    }
+
+    Py_DECREF(seq);
+    return 0;
+}
+
+static void apply_ammo(gclient_t* client, const int* ammo) {
+    for (int i = 0; i < weapons_desc.n_in_sequence; i++)
+        client->ps.ammo[i+1] = ammo[i];
+}
+
+// Times are in milliseconds, in the same order as minqlx.Powerups.
+static void apply_powerups(gclient_t* client, const int* times) {
+    // Quad -> Invulnerability, but skip flight.
+    for (int i = 0, pw = PW_QUAD; i < powerups_desc.n_in_sequence; i++, pw++) {
+        // Flight isn't a real powerup, so we bump it up and modify invulnerability instead.
+        if (pw == PW_FLIGHT)
+            pw = PW_INVULNERABILITY;
+
+        if (!times[i])
+            client->ps.powerups[pw] = 0;
+        else
+            client->ps.powerups[pw] = level->time - (level->time % 1000) + times[i];
+    }
+}
+
+static void apply_holdable(gclient_t* client, int holdable) {
+    if (holdable == 37)  // 37 - kamikaze
+        client->ps.eFlags |= EF_KAMIKAZE;
+    else
+        client->ps.eFlags &= ~EF_KAMIKAZE;
+
+    client->ps.stats[STAT_HOLDABLE_ITEM] = holdable;
+}
+
+/*
+ * A batch of changes to a player's state, as parsed from a dict by
+ * apply_player_state. Only the fields flagged in mask are applied.
+ */
+enum {
+    PCH_HEALTH = 1 << 0,
+    PCH_ARMOR = 1 << 1,
+    PCH_WEAPONS = 1 << 2,
+    PCH_WEAPON = 1 << 3,
+    PCH_AMMO = 1 << 4,
+    PCH_POWERUPS = 1 << 5,
+    PCH_HOLDABLE = 1 << 6
+};
+
+typedef struct {
+    int mask;
+    int health;
+    int armor;
+    int weapons;
+    int weapon;
+    int ammo[MAX_WEAPONS];
+    int powerups[PW_NUM_POWERUPS];
+    int holdable;
+} playerChanges_t;
+
+static int player_changes_from_pyobject(PyObject* dict, playerChanges_t* changes) {
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+
+    if (!PyDict_Check(dict)) {
+        PyErr_Format(PyExc_ValueError, "Player changes must be a dict.");
+        return -1;
+    }
+
+    changes->mask = 0;
+    while (PyDict_Next(dict, &pos, &key, &value)) {
+        const char* field = PyUnicode_Check(key) ? PyUnicode_AsUTF8(key) : NULL;
+        if (!field) {
+            PyErr_Format(PyExc_ValueError, "Player change fields must be strings.");
+            return -1;
+        }
+
+        if (!strcmp(field, "weapons")) {
+            if (weapons_from_pyobject(value, &changes->weapons) == -1)
+                return -1;
+            changes->mask |= PCH_WEAPONS;
+        }
+        else if (!strcmp(field, "ammo")) {
+            if (ammo_from_pyobject(value, changes->ammo) == -1)
+                return -1;
+            changes->mask |= PCH_AMMO;
+        }
+        else if (!strcmp(field, "powerups")) {
+            if (powerups_from_pyobject(value, changes->powerups) == -1)
+                return -1;
+            changes->mask |= PCH_POWERUPS;
+        }
+        else {
+            int* target;
+            int flag;
+            if (!strcmp(field, "health")) { target = &changes->health; flag = PCH_HEALTH; }
+            else if (!strcmp(field, "armor")) { target = &changes->armor; flag = PCH_ARMOR; }
+            else if (!strcmp(field, "weapon")) { target = &changes->weapon; flag = PCH_WEAPON; }
+            else if (!strcmp(field, "holdable")) { target = &changes->holdable; flag = PCH_HOLDABLE; }
+            else {
+                PyErr_Format(PyExc_ValueError, "Unknown player change field: %s.", field);
+                return -1;
+            }
+
+            if (!PyLong_Check(value)) {
+                PyErr_Format(PyExc_ValueError, "%s must be an integer.", field);
+                return -1;
+            }
+            *target = PyLong_AsLong(value);
+            changes->mask |= flag;
+        }
+    }
+
+    if ((changes->mask & PCH_WEAPON) && (changes->weapon < 0 || changes->weapon > 16)) {
+        PyErr_Format(PyExc_ValueError, "Weapon must be a number from 0 to 15.");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void apply_player_changes(gentity_t* ent, const playerChanges_t* changes) {
+    gclient_t* client = ent->client;
+
+    if (changes->mask & PCH_HEALTH)
+        ent->health = changes->health;
+    if (changes->mask & PCH_ARMOR)
+        client->ps.stats[STAT_ARMOR] = changes->armor;
+    if (changes->mask & PCH_WEAPONS)
+        client->ps.stats[STAT_WEAPONS] = changes->weapons;
+    if (changes->mask & PCH_WEAPON)
+        client->ps.weapon = changes->weapon;
+    if (changes->mask & PCH_AMMO)
+        apply_ammo(client, changes->ammo);
+    if (changes->mask & PCH_POWERUPS)
+        apply_powerups(client, changes->powerups);
+    if (changes->mask & PCH_HOLDABLE)
+        apply_holdable(client, changes->holdable);
+}
+
 /*
 * ================================================================
 *                           set_health
@@ -964,16 +1230,8 @@ static PyObject* PyMinqlx_SetWeapons(PyObject* self, PyObject* args) {
         return NULL;
     }
 
-    PyObject* w;
-    for (int i = 0; i < weapons_desc.n_in_sequence; i++) {
-        w = PyStructSequence_GetItem(weapons, i);
-        if (!PyBool_Check(w)) {
-            PyErr_Format(PyExc_ValueError, "Tuple argument %d is not a boolean.", i);
-            return NULL;
-        }
-
-        weapon_flags |= w == Py_True ? (1 << (i+1)) : 0;
-    }
+    if (weapons_from_pyobject(weapons, &weapon_flags) == -1)
+        return NULL;
 
     g_entities[client_id].client->ps.stats[STAT_WEAPONS] = weapon_flags;
     Py_RETURN_TRUE;
@@ -1030,17 +1288,11 @@ static PyObject* PyMinqlx_SetAmmo(PyObject* self, PyObject* args) {
         return NULL;
     }
 
-    PyObject* a;
-    for (int i = 0; i < weapons_desc.n_in_sequence; i++) {
-        a = PyStructSequence_GetItem(ammos, i);
-        if (!PyLong_Check(a)) {
-            PyErr_Format(PyExc_ValueError, "Tuple argument %d is not an integer.", i);
-            return NULL;
-        }
-
-        g_entities[client_id].client->ps.ammo[i+1] = PyLong_AsLong(a);
-    }
+    int ammo[MAX_WEAPONS];
+    if (ammo_from_pyobject(ammos, ammo) == -1)
+        return NULL;
 
+    apply_ammo(g_entities[client_id].client, ammo);
     Py_RETURN_TRUE;
 }
 
@@ -1051,7 +1303,7 @@ static PyObject* PyMinqlx_SetAmmo(PyObject* self, PyObject* args) {
 */
 
 static PyObject* PyMinqlx_SetPowerups(PyObject* self, PyObject* args) {
-    int client_id, t;
+    int client_id;
     PyObject* powerups;
     if (!PyArg_ParseTuple(args, "iO:set_powerups", &client_id, &powerups))
         return NULL;
@@ -1068,30 +1320,11 @@ static PyObject* PyMinqlx_SetPowerups(PyObject* self, PyObject* args) {
         return NULL;
     }
 
-    PyObject* powerup;
-
-    // Quad -> Invulnerability, but skip flight.
-    for (int i = 0; i < powerups_desc.n_in_sequence; i++) {
-        powerup = PyStructSequence_GetItem(powerups, i);
-        if (!PyLong_Check(powerup)) {
-            PyErr_Format(PyExc_ValueError, "Tuple argument %d is not an integer.", i);
-            return NULL;
-        }
-
-        // If i == 5, it'll modify flight, which isn't a real powerup.
-        // We bump it up and modify invulnerability instead.
-        if (i+PW_QUAD == PW_FLIGHT)
-            i = PW_INVULNERABILITY - PW_QUAD;
-
-        t = PyLong_AsLong(powerup);
-        if (!t) {
-            g_entities[client_id].client->ps.powerups[i+PW_QUAD] = 0;
-            continue;
-        }
-
-        g_entities[client_id].client->ps.powerups[i+PW_QUAD] = level->time - (level->time % 1000) + t;
-    }
+    int times[PW_NUM_POWERUPS];
+    if (powerups_from_pyobject(powerups, times) == -1)
+        return NULL;
 
+    apply_powerups(g_entities[client_id].client, times);
     Py_RETURN_TRUE;
 }
 
@@ -1114,15 +1347,238 @@ static PyObject* PyMinqlx_SetHoldable(PyObject* self, PyObject* args) {
     else if (!g_entities[client_id].client)
         Py_RETURN_FALSE;
 
-    if (i == 37)  // 37 - kamikaze
-        g_entities[client_id].client->ps.eFlags |= EF_KAMIKAZE;
-    else
-        g_entities[client_id].client->ps.eFlags &= ~EF_KAMIKAZE;
-
-    g_entities[client_id].client->ps.stats[STAT_HOLDABLE_ITEM] = i;
+    apply_holdable(g_entities[client_id].client, i);
     Py_RETURN_TRUE;
 }
 
+/*
+* ================================================================
+*                       apply_player_state
+* ================================================================
+*/
+
+static PyObject* apply_player_state(PyObject* args, playerChanges_t* player_changes) {
+    PyObject *changes, *client_ids = NULL;
+    int targets[MAX_CLIENTS], count = 0, applied = 0;
+
+    if (!PyArg_ParseTuple(args, "O|O:apply_player_state", &changes, &client_ids))
+        return NULL;
+
+    // Everything is parsed and validated before any player is touched.
+    if (client_ids) {
+        // One set of changes applied to a list of players.
+        if (player_changes_from_pyobject(changes, &player_changes[0]) == -1)
+            return NULL;
+
+        PyObject* seq = PySequence_Fast(client_ids, "client_ids must be a sequence.");
+        if (!seq)
+            return NULL;
+
+        Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+        for (Py_ssize_t i = 0; i < n && count < MAX_CLIENTS; i++) {
+            int client_id = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+            if (PyErr_Occurred() || client_id < 0 || client_id >= sv_maxclients->integer) {
+                PyErr_Clear();
+                PyErr_Format(PyExc_ValueError,
+                             "client_id needs to be a number from 0 to %d.",
+                             sv_maxclients->integer);
+                Py_DECREF(seq);
+                return NULL;
+            }
+            targets[count++] = client_id;
+        }
+        Py_DECREF(seq);
+
+        for (int i = 0; i < count; i++) {
+            if (!g_entities[targets[i]].client)
+                continue;
+            apply_player_changes(&g_entities[targets[i]], &player_changes[0]);
+            applied++;
+        }
+
+        return PyLong_FromLong(applied);
+    }
+    else if (!PyDict_Check(changes)) {
+        PyErr_Format(PyExc_ValueError, "apply_player_state takes a dict of client IDs to changes, or changes and a list of client IDs.");
+        return NULL;
+    }
+
+    // A dict of client IDs to their own changes.
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(changes, &pos, &key, &value) && count < MAX_CLIENTS) {
+        int client_id = PyLong_Check(key) ? PyLong_AsLong(key) : -1;
+        if (client_id < 0 || client_id >= sv_maxclients->integer) {
+            PyErr_Format(PyExc_ValueError,
+                         "client_id needs to be a number from 0 to %d.",
+                         sv_maxclients->integer);
+            return NULL;
+        }
+        if (player_changes_from_pyobject(value, &player_changes[count]) == -1)
+            return NULL;
+        targets[count++] = client_id;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (!g_entities[targets[i]].client)
+            continue;
+        apply_player_changes(&g_entities[targets[i]], &player_changes[i]);
+        applied++;
+    }
+
+    return PyLong_FromLong(applied);
+}
+
+// The changes are parsed into a buffer of its own for every call, since plugin
+// threads can call this at the same time when the GIL is disabled.
+static PyObject* PyMinqlx_ApplyPlayerState(PyObject* self, PyObject* args) {
+    playerChanges_t* player_changes = malloc(sizeof(playerChanges_t) * MAX_CLIENTS);
+    if (!player_changes)
+        return PyErr_NoMemory();
+
+    PyObject* ret = apply_player_state(args, player_changes);
+    free(player_changes);
+    return ret;
+}
+
+/*
+* ================================================================
+*                       set_spawn_template
+* ================================================================
+*/
+
+#define MAX_SPAWN_TEMPLATES 32
+
+/*
+ * Spawn templates are player changes applied right after ClientSpawn, so that
+ * the common case of giving everyone the same loadout never has to enter Python.
+ * A template can be limited to a team and/or a factory. For every team, the most
+ * specific template for the current factory is picked whenever the game is
+ * initialized or the templates change.
+ */
+typedef struct {
+    int inuse;
+    int team; // -1 for any team.
+    char factory[64]; // Empty for any factory.
+    playerChanges_t changes;
+} spawnTemplate_t;
+
+static spawnTemplate_t spawn_templates[MAX_SPAWN_TEMPLATES];
+static playerChanges_t* active_spawn_templates[TEAM_NUM_TEAMS];
+// Plugin threads can set templates while the engine thread applies them.
+static pthread_mutex_t spawn_template_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Must be called with the lock held.
+static void ResolveSpawnTemplatesLocked(void) {
+    cvar_t* g_factory = Cvar_FindVar("g_factory");
+    const char* factory = g_factory ? g_factory->string : "";
+
+    for (int team = 0; team < TEAM_NUM_TEAMS; team++) {
+        int best_score = -1;
+        active_spawn_templates[team] = NULL;
+        if (team == TEAM_SPECTATOR)
+            continue;
+
+        for (int i = 0; i < MAX_SPAWN_TEMPLATES; i++) {
+            spawnTemplate_t* t = &spawn_templates[i];
+            if (!t->inuse || (t->team != -1 && t->team != team) ||
+                (t->factory[0] && strcmp(t->factory, factory)))
+                continue;
+
+            int score = (t->factory[0] ? 2 : 0) + (t->team != -1 ? 1 : 0);
+            if (score > best_score) {
+                best_score = score;
+                active_spawn_templates[team] = &t->changes;
+            }
+        }
+    }
+}
+
+void ResolveSpawnTemplates(void) {
+    pthread_mutex_lock(&spawn_template_lock);
+    ResolveSpawnTemplatesLocked();
+    pthread_mutex_unlock(&spawn_template_lock);
+}
+
+void ApplySpawnTemplate(gentity_t* ent) {
+    if (!ent->client)
+        return;
+
+    int team = ent->client->sess.sessionTeam;
+    if (team < 0 || team >= TEAM_NUM_TEAMS)
+        return;
+
+    pthread_mutex_lock(&spawn_template_lock);
+    int found = active_spawn_templates[team] != NULL;
+    playerChanges_t changes;
+    if (found)
+        changes = *active_spawn_templates[team];
+    pthread_mutex_unlock(&spawn_template_lock);
+
+    if (found)
+        apply_player_changes(ent, &changes);
+}
+
+static PyObject* PyMinqlx_SetSpawnTemplate(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"team", "changes", "factory", NULL};
+    int team;
+    PyObject* changes;
+    const char* factory = NULL;
+    spawnTemplate_t* slot = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iO|z:set_spawn_template", kwlist, &team, &changes, &factory))
+        return NULL;
+    else if (team != -1 && (team < TEAM_FREE || team >= TEAM_SPECTATOR)) {
+        PyErr_Format(PyExc_ValueError, "team needs to be -1 or a number from %d to %d.", TEAM_FREE, TEAM_SPECTATOR - 1);
+        return NULL;
+    }
+    else if (factory && strlen(factory) >= sizeof(slot->factory)) {
+        PyErr_Format(PyExc_ValueError, "factory name is too long.");
+        return NULL;
+    }
+
+    if (!factory)
+        factory = "";
+
+    playerChanges_t parsed;
+    if (changes != Py_None && player_changes_from_pyobject(changes, &parsed) == -1)
+        return NULL;
+
+    // Replace an existing template for the same team and factory, if any.
+    pthread_mutex_lock(&spawn_template_lock);
+    for (int i = 0; i < MAX_SPAWN_TEMPLATES; i++) {
+        spawnTemplate_t* t = &spawn_templates[i];
+        if (t->inuse && t->team == team && !strcmp(t->factory, factory)) {
+            slot = t;
+            break;
+        }
+        else if (!t->inuse && !slot)
+            slot = t;
+    }
+
+    if (changes == Py_None) {
+        if (slot && slot->inuse)
+            slot->inuse = 0;
+        ResolveSpawnTemplatesLocked();
+        pthread_mutex_unlock(&spawn_template_lock);
+        Py_RETURN_NONE;
+    }
+    else if (!slot) {
+        pthread_mutex_unlock(&spawn_template_lock);
+        PyErr_Format(PyExc_RuntimeError, "The maximum of %d spawn templates has been reached.", MAX_SPAWN_TEMPLATES);
+        return NULL;
+    }
+
+    slot->changes = parsed;
+    slot->team = team;
+    strcpy(slot->factory, factory);
+    slot->inuse = 1;
+    ResolveSpawnTemplatesLocked();
+    pthread_mutex_unlock(&spawn_template_lock);
+
+    Py_RETURN_NONE;
+}
+
 /*
 * ================================================================
 *                          drop_holdable
@@ -1167,6 +1623,7 @@ static PyObject* PyMinqlx_DropHoldable(PyObject* self, PyObject* args) {
     velocity[2] = 250;
 
     gentity_t* entity = LaunchItem(bg_itemlist + item, g_entities[client_id].s.pos.trBase, velocity);
+    SpatialIndexInvalidate();
     entity->touch     = (void*)My_Touch_Item;
     entity->parent    = &g_entities[client_id];
     entity->think     = Switch_Touch_Item;
@@ -1372,10 +1829,11 @@ static PyObject* PyMinqlx_SetPrivileges(PyObject* self, PyObject* args) {
 */
 
 static PyObject* PyMinqlx_DestroyKamikazeTimers(PyObject* self, PyObject* args) {
-    int i;
+    int ids[MAX_GENTITIES];
+    entityFilter_t filter = {"kamikaze timer", -1, -1, -1};
     gentity_t* ent;
 
-    for (i = 0; i < MAX_GENTITIES; i++) {
+    for (int i = 0; i < sv_maxclients->integer; i++) {
         ent = &g_entities[i];
         if (!ent->inuse)
             continue;
@@ -1384,10 +1842,12 @@ static PyObject* PyMinqlx_DestroyKamikazeTimers(PyObject* self, PyObject* args)
         if (ent->client && ent->health <= 0) {
             ent->client->ps.eFlags &= ~EF_KAMIKAZE;
         }
-
-        if (strcmp(ent->classname, "kamikaze timer") == 0)
-            G_FreeEntity(ent);
     }
+
+    int count = FindEntities(&filter, ids, MAX_GENTITIES);
+    for (int i = 0; i < count; i++)
+        G_FreeEntity(&g_entities[ids[i]]);
+
     Py_RETURN_TRUE;
 }
 
@@ -1412,6 +1872,7 @@ static PyObject* PyMinqlx_SpawnItem(PyObject* self, PyObject* args) {
     vec3_t velocity = {0};
 
     gentity_t* ent = LaunchItem(bg_itemlist + item_id, origin, velocity);
+    SpatialIndexInvalidate();
     ent->nextthink = 0;
     ent->think = 0;
     G_AddEvent(ent, EV_ITEM_RESPAWN, 0); // make item be scaled up
@@ -1426,17 +1887,13 @@ static PyObject* PyMinqlx_SpawnItem(PyObject* self, PyObject* args) {
 */
 
 static PyObject* PyMinqlx_RemoveDroppedItems(PyObject* self, PyObject* args) {
-    int i;
-    gentity_t* ent;
+    int ids[MAX_GENTITIES];
+    entityFilter_t filter = {NULL, -1, -1, 1};
 
-    for (i = 0; i < MAX_GENTITIES; i++) {
-        ent = &g_entities[i];
-        if (!ent->inuse)
-            continue;
+    int count = FindEntities(&filter, ids, MAX_GENTITIES);
+    for (int i = 0; i < count; i++)
+        G_FreeEntity(&g_entities[ids[i]]);
 
-        if (ent->flags & FL_DROPPED_ITEM)
-            G_FreeEntity(ent);
-    }
     Py_RETURN_TRUE;
 }
 
@@ -1478,121 +1935,363 @@ static PyObject* PyMinqlx_SlayWithMod(PyObject* self, PyObject* args) {
 * ================================================================
 */
 
-void replace_item_core(gentity_t* ent, int item_id) {
-    char csbuffer[4096];
-
-    if (item_id) {
-        ent->s.modelindex = item_id;
-        ent->classname = bg_itemlist[item_id].classname;
-        ent->item = &bg_itemlist[item_id];
-
-        // this forces client to load new item
-        SV_GetConfigstring(CS_ITEMS, csbuffer, sizeof(csbuffer));
-        csbuffer[item_id] = '1';
-        My_SV_SetConfigstring(CS_ITEMS, csbuffer);
-
-    } else {
+/*
+ * Replaces the item of an entity, or removes the entity if item_id is 0. Clients
+ * only load the models of items flagged in CS_ITEMS, so the item is flagged in
+ * items_cs, which is a copy of CS_ITEMS the caller sends once it's done with all
+ * the replacements. Returns 1 if items_cs was changed.
+ */
+static int replace_item_core(gentity_t* ent, int item_id, char* items_cs, int items_cs_len) {
+    if (!item_id) {
         G_FreeEntity(ent);
+        return 0;
     }
-}
 
-static PyObject* PyMinqlx_ReplaceItems(PyObject* self, PyObject* args) {
-    PyObject *arg1, *arg2 ;
-    int entity_id = 0, item_id = 0;
-    char *entity_classname = NULL, *item_classname = NULL;
-    gentity_t* ent;
+    ent->s.modelindex = item_id;
+    ent->classname = bg_itemlist[item_id].classname;
+    ent->item = &bg_itemlist[item_id];
 
+    if (item_id >= items_cs_len || items_cs[item_id] == '1')
+        return 0;
 
-    if (!PyArg_ParseTuple(args, "OO:replace_items", &arg1, &arg2))
-        return NULL;
+    items_cs[item_id] = '1';
+    return 1;
+}
 
-    // checking type of first arg
-    if (PyLong_Check(arg1)) {
-        entity_id = PyLong_AsLong(arg1);
-    } else if (PyUnicode_Check(arg1))
-        entity_classname = PyUnicode_AsUTF8(arg1);
-    else {
-        PyErr_Format(PyExc_ValueError, "entity needs to be type of int or string.");
-        return NULL;
-    }
+// Returns the item ID of an item ID or item classname, or -1 with an exception set.
+static int item_from_pyobject(PyObject* item) {
+    int item_id;
 
-    // checking type of second arg
-    if (PyLong_Check(arg2))
-        item_id = PyLong_AsLong(arg2);
-    else if (PyUnicode_Check(arg2))
-        item_classname = PyUnicode_AsUTF8(arg2);
-    else {
-        PyErr_Format(PyExc_ValueError, "item needs to be type of int or string.");
-        return NULL;
+    if (PyLong_Check(item)) {
+        item_id = PyLong_AsLong(item);
+        if (item_id < 0 || item_id >= bg_numItems) {
+            PyErr_Format(PyExc_ValueError, "item_id needs to be between 0 and %d.", bg_numItems-1);
+            return -1;
+        }
+        return item_id;
     }
-
-    // convert second arg to item_id, if needed
-    int i=1;
-    if (item_classname == NULL) i=bg_numItems;
-    for (; i<bg_numItems; i++)
-        if (strcmp(bg_itemlist[i].classname, item_classname) == 0) {
-            item_id = i;
-            break;
+    else if (PyUnicode_Check(item)) {
+        const char* item_classname = PyUnicode_AsUTF8(item);
+        for (item_id = 1; item_id < bg_numItems; item_id++) {
+            if (strcmp(bg_itemlist[item_id].classname, item_classname) == 0)
+                return item_id;
         }
-
-    // checking for valid item_id or item_classname
-    if (item_classname && item_id == 0) {
-
-        // throw error if invalid item_classname
         PyErr_Format(PyExc_ValueError, "invalid item classname: %s.", item_classname);
-        return NULL;
-    } else if (item_id < 0 || item_id >= bg_numItems) {
-
-        // throw error if invalid item_id
-        PyErr_Format(PyExc_ValueError, "item_id needs to be between 0 and %d.", bg_numItems-1);
-        return NULL;
+        return -1;
     }
 
-    // Note: if item_id == 0 and item_classname == NULL, then item will be removed
-
-    if (entity_classname == NULL) {
-        // replacing item by entity_id
+    PyErr_Format(PyExc_ValueError, "item needs to be type of int or string.");
+    return -1;
+}
 
-        // entity_id checking
+/* Writes the item entities an entity ID or entity classname refers to into ids.
+ * Returns how many there were, or -1 with an exception set. An unknown classname
+ * is not an error, it simply matches nothing. */
+static int item_entities_from_pyobject(PyObject* entity, int* ids, int max) {
+    if (PyLong_Check(entity)) {
+        int entity_id = PyLong_AsLong(entity);
         if (entity_id < 0 || entity_id >= MAX_GENTITIES) {
             PyErr_Format(PyExc_ValueError, "entity_id needs to be between 0 and %d.", MAX_GENTITIES-1);
-            return NULL;
+            return -1;
         } else if (g_entities[entity_id].inuse == 0) {
             PyErr_Format(PyExc_ValueError, "entity #%d is not in use.", entity_id);
-            return NULL;
+            return -1;
         } else if (g_entities[entity_id].s.eType != ET_ITEM) {
             PyErr_Format(PyExc_ValueError, "entity #%d is not item. Cannot replace it.", entity_id);
-            return NULL;
+            return -1;
         }
+        ids[0] = entity_id;
+        return 1;
+    }
+    else if (PyUnicode_Check(entity)) {
+        entityFilter_t filter = {PyUnicode_AsUTF8(entity), ET_ITEM, -1, -1};
+        return FindEntities(&filter, ids, max);
+    }
 
-        Com_Printf("%s\n", g_entities[entity_id].classname);
-        replace_item_core(&g_entities[entity_id], item_id);
-        Py_RETURN_TRUE;
+    PyErr_Format(PyExc_ValueError, "entity needs to be type of int or string.");
+    return -1;
+}
+
+static PyObject* PyMinqlx_ReplaceItems(PyObject* self, PyObject* args) {
+    PyObject *arg1, *arg2 = NULL;
+    static __thread int ids[MAX_GENTITIES];
+    char items_cs[4096];
+    int items_changed = 0, replaced = 0;
 
-    } else {
-        // replacing items by entity_classname
+    if (!PyArg_ParseTuple(args, "O|O:replace_items", &arg1, &arg2))
+        return NULL;
 
-        int is_entity_found = 0;
-        for (i=0; i<MAX_GENTITIES; i++) {
-            ent = &g_entities[i];
+    // Note: if item is 0, then the entity will be removed.
+    if (arg2) {
+        // Single replacement, by entity ID or entity classname.
+        int item_id = item_from_pyobject(arg2);
+        if (item_id == -1)
+            return NULL;
 
-            if (!ent->inuse)
-                continue;
+        int count = item_entities_from_pyobject(arg1, ids, MAX_GENTITIES);
+        if (count == -1)
+            return NULL;
 
-            if (ent->s.eType != ET_ITEM)
-                continue;
+        My_SV_GetConfigstring(CS_ITEMS, items_cs, sizeof(items_cs));
+        int items_cs_len = strlen(items_cs);
+        for (int i = 0; i < count; i++)
+            items_changed |= replace_item_core(&g_entities[ids[i]], item_id, items_cs, items_cs_len);
 
-            if (strcmp(ent->classname, entity_classname) == 0) {
-                is_entity_found = 1;
-                replace_item_core(ent, item_id);
-            }
-        }
+        if (items_changed)
+            My_SV_SetConfigstring(CS_ITEMS, items_cs);
 
-        if (is_entity_found)
-            Py_RETURN_TRUE;
-        else
-            Py_RETURN_FALSE;
+        return PyBool_FromLong(count);
     }
+    else if (!PyDict_Check(arg1)) {
+        PyErr_Format(PyExc_ValueError, "replace_items takes either an entity and an item, or a dict mapping entities to items.");
+        return NULL;
+    }
+
+    // Batch of replacements. Figure out what every entity becomes before replacing
+    // anything, so that a bad entry doesn't leave us with half the layout replaced,
+    // and so that swaps and chains like {"item_armor_red": "item_armor_yellow",
+    // "item_armor_yellow": "item_armor_red"} don't see the result of earlier entries.
+    // Then apply everything and send CS_ITEMS only once at the end.
+    static __thread int targets[MAX_GENTITIES];
+    for (int i = 0; i < MAX_GENTITIES; i++)
+        targets[i] = -1;
+
+    PyObject *entity, *item;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(arg1, &pos, &entity, &item)) {
+        int item_id = item_from_pyobject(item);
+        if (item_id == -1)
+            return NULL;
+        int count = item_entities_from_pyobject(entity, ids, MAX_GENTITIES);
+        if (count == -1)
+            return NULL;
+
+        for (int i = 0; i < count; i++)
+            targets[ids[i]] = item_id;
+    }
+
+    My_SV_GetConfigstring(CS_ITEMS, items_cs, sizeof(items_cs));
+    int items_cs_len = strlen(items_cs);
+
+    for (int i = 0; i < MAX_GENTITIES; i++) {
+        if (targets[i] == -1)
+            continue;
+        items_changed |= replace_item_core(&g_entities[i], targets[i], items_cs, items_cs_len);
+        replaced++;
+    }
+
+    if (items_changed)
+        My_SV_SetConfigstring(CS_ITEMS, items_cs);
+
+    return PyLong_FromLong(replaced);
+}
+
+/*
+* ================================================================
+*                         spawn_items
+* ================================================================
+*/
+
+typedef struct {
+    int item_id;
+    vec3_t origin;
+    int wait; // Respawn time in seconds. 0 means it's gone once picked up, like spawn_item.
+} itemSpawn_t;
+
+// Entities spawn_items leaves free for the game, so it doesn't run out right after.
+#define SPAWN_ITEMS_RESERVE 64
+
+// Reads a layout file with one "<item classname or id> <x> <y> <z> [respawn wait]" per line.
+// Empty lines and lines starting with # are ignored. Returns the number of items, or -1 with
+// an exception set.
+static int read_item_layout(const char* path, itemSpawn_t* spawns, int max) {
+    char line[256], item[128];
+    int count = 0, line_number = 0;
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        line_number++;
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || !*p)
+            continue;
+
+        if (count == max) {
+            PyErr_Format(PyExc_ValueError, "%s has more than %d items.", path, max);
+            fclose(f);
+            return -1;
+        }
+
+        itemSpawn_t* spawn = &spawns[count];
+        int fields, end_xyz = 0, end_wait = 0;
+        spawn->wait = 0;
+        fields = sscanf(p, "%127s %f %f %f%n %d%n", item, &spawn->origin[0], &spawn->origin[1],
+                        &spawn->origin[2], &end_xyz, &spawn->wait, &end_wait);
+        // Anything but whitespace after the last field means the line isn't what we think it is.
+        char* rest = p + (fields == 5 ? end_wait : end_xyz);
+        while (fields >= 4 && (*rest == ' ' || *rest == '\t' || *rest == '\r' || *rest == '\n')) rest++;
+        if (fields < 4 || *rest) {
+            PyErr_Format(PyExc_ValueError, "%s:%d: expected an item followed by x, y, z and optionally a respawn time.",
+                         path, line_number);
+            fclose(f);
+            return -1;
+        }
+
+        char* end;
+        spawn->item_id = strtol(item, &end, 10);
+        if (*end) {
+            for (spawn->item_id = bg_numItems - 1; spawn->item_id > 0; spawn->item_id--) {
+                if (!strcmp(bg_itemlist[spawn->item_id].classname, item))
+                    break;
+            }
+        }
+        if (spawn->item_id <= 0 || spawn->item_id >= bg_numItems) {
+            PyErr_Format(PyExc_ValueError, "%s:%d: invalid item: %s.", path, line_number, item);
+            fclose(f);
+            return -1;
+        }
+        count++;
+    }
+
+    fclose(f);
+    return count;
+}
+
+// Takes a sequence of (item, (x, y, z)) or (item, (x, y, z), wait) tuples.
+static int read_item_list(PyObject* layout, itemSpawn_t* spawns, int max) {
+    PyObject* seq = PySequence_Fast(layout, "layout needs to be a sequence or a path to a layout file.");
+    if (!seq)
+        return -1;
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    if (count > max) {
+        PyErr_Format(PyExc_ValueError, "cannot spawn more than %d items at once.", max);
+        Py_DECREF(seq);
+        return -1;
+    }
+
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject* entry = PySequence_Fast_GET_ITEM(seq, i);
+        PyObject* item;
+        itemSpawn_t* spawn = &spawns[i];
+        spawn->wait = 0;
+
+        if (!PyTuple_Check(entry) || !PyArg_ParseTuple(entry, "O(fff)|i:spawn_items", &item,
+            &spawn->origin[0], &spawn->origin[1], &spawn->origin[2], &spawn->wait)) {
+            if (!PyErr_Occurred())
+                PyErr_Format(PyExc_ValueError, "layout entries need to be (item, (x, y, z)[, wait]) tuples.");
+            Py_DECREF(seq);
+            return -1;
+        }
+
+        spawn->item_id = item_from_pyobject(item);
+        if (spawn->item_id == -1) {
+            Py_DECREF(seq);
+            return -1;
+        }
+        else if (spawn->item_id == 0) {
+            PyErr_Format(PyExc_ValueError, "item_id needs to be between 1 and %d.", bg_numItems-1);
+            Py_DECREF(seq);
+            return -1;
+        }
+    }
+
+    Py_DECREF(seq);
+    return count;
+}
+
+static PyObject* spawn_items(PyObject* args, itemSpawn_t* spawns) {
+    PyObject* layout;
+    char items_cs[4096];
+    int count, items_changed = 0;
+    vec3_t velocity = {0};
+
+    if (!PyArg_ParseTuple(args, "O:spawn_items", &layout))
+        return NULL;
+
+    // Everything is parsed and validated before we spawn anything.
+    if (PyUnicode_Check(layout)) {
+        // Relative paths are relative to fs_homepath, like everything else we write or read.
+        char path[4096];
+        const char* name = PyUnicode_AsUTF8(layout);
+        cvar_t* homepath = Cvar_FindVar("fs_homepath");
+        if (!name)
+            return NULL;
+        else if (name[0] != '/' && homepath && homepath->string[0])
+            snprintf(path, sizeof(path), "%s/%s", homepath->string, name);
+        else
+            snprintf(path, sizeof(path), "%s", name);
+        count = read_item_layout(path, spawns, MAX_GENTITIES);
+    }
+    else
+        count = read_item_list(layout, spawns, MAX_GENTITIES);
+
+    if (count == -1)
+        return NULL;
+
+    // G_Spawn calls G_Error and takes the server down if it runs out of entities,
+    // so make sure all of them fit, with some room to spare for the game itself.
+    int num_entities = level->num_entities;
+    int free_entities = ENTITYNUM_MAX_NORMAL - num_entities;
+    for (int i = MAX_CLIENTS; i < num_entities; i++) {
+        if (!g_entities[i].inuse)
+            free_entities++;
+    }
+    if (count > free_entities - SPAWN_ITEMS_RESERVE) {
+        PyErr_Format(PyExc_ValueError, "cannot spawn %d items, there's only room for %d more.",
+                     count, free_entities > SPAWN_ITEMS_RESERVE ? free_entities - SPAWN_ITEMS_RESERVE : 0);
+        return NULL;
+    }
+
+    PyObject* ret = PyList_New(count);
+    if (!ret)
+        return NULL;
+
+    My_SV_GetConfigstring(CS_ITEMS, items_cs, sizeof(items_cs));
+    int items_cs_len = strlen(items_cs);
+
+    for (int i = 0; i < count; i++) {
+        itemSpawn_t* spawn = &spawns[i];
+        gentity_t* ent = LaunchItem(bg_itemlist + spawn->item_id, spawn->origin, velocity);
+        ent->nextthink = 0;
+        ent->think = 0;
+        if (spawn->wait > 0) {
+            // Not being a dropped item makes it respawn when picked up instead of getting freed.
+            ent->flags &= ~FL_DROPPED_ITEM;
+            ent->wait = spawn->wait;
+        }
+        G_AddEvent(ent, EV_ITEM_RESPAWN, 0); // make item be scaled up
+
+        if (spawn->item_id < items_cs_len && items_cs[spawn->item_id] != '1') {
+            items_cs[spawn->item_id] = '1';
+            items_changed = 1;
+        }
+
+        PyList_SET_ITEM(ret, i, PyLong_FromLong(ent - g_entities));
+    }
+    SpatialIndexInvalidate();
+
+    // Make sure clients load the models of everything we spawned.
+    if (items_changed)
+        My_SV_SetConfigstring(CS_ITEMS, items_cs);
+
+    return ret;
+}
+
+// Like apply_player_state, every call gets a buffer of its own.
+static PyObject* PyMinqlx_SpawnItems(PyObject* self, PyObject* args) {
+    itemSpawn_t* spawns = malloc(sizeof(itemSpawn_t) * MAX_GENTITIES);
+    if (!spawns)
+        return PyErr_NoMemory();
+
+    PyObject* ret = spawn_items(args, spawns);
+    free(spawns);
+    return ret;
 }
 
 /*
@@ -1608,19 +2307,17 @@ static PyObject* PyMinqlx_DevPrintItems(PyObject* self, PyObject* args) {
     size_t chars_written;
     char format[] = "%d %s\n";
     qboolean is_buffer_enough = qtrue;
+    int ids[MAX_GENTITIES];
+    entityFilter_t filter = {NULL, ET_ITEM, -1, -1};
 
     // default results
     sprintf(buffer, "No items found in the map");
 
-    for (int i=0; i<MAX_GENTITIES; i++) {
+    int count = FindEntities(&filter, ids, MAX_GENTITIES);
+    for (int j=0; j<count; j++) {
+        int i = ids[j];
         ent = &g_entities[i];
 
-        if (!ent->inuse)
-            continue;
-
-        if (ent->s.eType != ET_ITEM)
-            continue;
-
         chars_written = sprintf(temp_buffer, format, i, ent->classname);
         if (is_buffer_enough && buffer_index + chars_written >= sizeof(buffer)) {
             is_buffer_enough = qfalse;
@@ -1649,7 +2346,8 @@ static PyObject* PyMinqlx_DevPrintItems(PyObject* self, PyObject* args) {
 
 static PyObject* PyMinqlx_ForceWeaponRespawnTime(PyObject* self, PyObject* args) {
 	int respawn_time;
-    gentity_t* ent;
+    int ids[MAX_GENTITIES];
+    entityFilter_t filter = {NULL, ET_ITEM, IT_WEAPON, -1};
 	
 	if (!PyArg_ParseTuple(args, "i:force_weapon_respawn_time", &respawn_time))
 		return NULL;
@@ -1659,24 +2357,627 @@ static PyObject* PyMinqlx_ForceWeaponRespawnTime(PyObject* self, PyObject* args)
         return NULL;
     }	
 
-    for (int i=0; i<MAX_GENTITIES; i++) {
-        ent = &g_entities[i];
+    int count = FindEntities(&filter, ids, MAX_GENTITIES);
+    for (int i=0; i<count; i++)
+        g_entities[ids[i]].wait = respawn_time;
 
-        if (!ent->inuse)
-            continue;
+    Py_RETURN_TRUE;
+}
+
+/*
+ * ================================================================
+ *                        drain_usercmds
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_DrainUsercmds(PyObject* self, PyObject* args) {
+    int client_id;
+    if (!PyArg_ParseTuple(args, "i:drain_usercmds", &client_id))
+        return NULL;
 
-		if (ent->s.eType != ET_ITEM || ent->item == NULL)
-            continue;		
-		
-		if (ent->item->giType != IT_WEAPON)
-			continue;
-				
-		ent->wait = respawn_time;
+    if (client_id < 0 || client_id >= sv_maxclients->integer) {
+        PyErr_Format(PyExc_ValueError,
+                     "client_id needs to be a number from 0 to %d.",
+                     sv_maxclients->integer);
+        return NULL;
     }
 
+    // Drain straight into the bytes object and shrink it afterwards, since
+    // the writer might have added a few more records in the meantime.
+    PyObject* ret = PyBytes_FromStringAndSize(NULL, USERCMD_BUFFER_SIZE * sizeof(usercmd_record_t));
+    if (!ret)
+        return NULL;
+
+    int count = UsercmdBufferDrain(client_id, (usercmd_record_t*)PyBytes_AS_STRING(ret), USERCMD_BUFFER_SIZE);
+    if (_PyBytes_Resize(&ret, count * sizeof(usercmd_record_t)) == -1)
+        return NULL;
+
+    return ret;
+}
+
+/*
+ * ================================================================
+ *                       pending_usercmds
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_PendingUsercmds(PyObject* self, PyObject* args) {
+    int client_id;
+    if (!PyArg_ParseTuple(args, "i:pending_usercmds", &client_id))
+        return NULL;
+
+    if (client_id < 0 || client_id >= sv_maxclients->integer) {
+        PyErr_Format(PyExc_ValueError,
+                     "client_id needs to be a number from 0 to %d.",
+                     sv_maxclients->integer);
+        return NULL;
+    }
+
+    return PyLong_FromLong(UsercmdBufferCount(client_id));
+}
+
+/*
+ * ================================================================
+ *                      server_command_queue
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_ServerCommandQueue(PyObject* self, PyObject* args) {
+    int client_id;
+    if (!PyArg_ParseTuple(args, "i:server_command_queue", &client_id))
+        return NULL;
+
+    if (client_id < 0 || client_id >= sv_maxclients->integer) {
+        PyErr_Format(PyExc_ValueError,
+                     "client_id needs to be a number from 0 to %d.",
+                     sv_maxclients->integer);
+        return NULL;
+    }
+
+    return PyLong_FromLong(CommandQueueDepth(client_id));
+}
+
+/*
+ * ================================================================
+ *                           add_timer
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_AddTimer(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"callback", "delay", "wall_clock", NULL};
+    PyObject* callback;
+    double delay;
+    int wall_clock = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Od|p:add_timer", kwlist, &callback, &delay, &wall_clock))
+        return NULL;
+
+    if (!PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "The callback needs to be callable.");
+        return NULL;
+    }
+    else if (delay < 0 || delay * 1000 > INT_MAX) {
+        PyErr_SetString(PyExc_ValueError, "The delay needs to be a positive number of seconds.");
+        return NULL;
+    }
+
+    // The timer holds a reference until it fires or is cancelled.
+    Py_INCREF(callback);
+    int64_t timer_id = AddTimer(wall_clock ? TIMER_WALL_CLOCK : TIMER_GAME_TIME, (int)(delay * 1000), callback);
+    if (timer_id == -1) {
+        Py_DECREF(callback);
+        return PyErr_NoMemory();
+    }
+
+    return PyLong_FromLongLong(timer_id);
+}
+
+/*
+ * ================================================================
+ *                          cancel_timer
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_CancelTimer(PyObject* self, PyObject* args) {
+    long long timer_id;
+    void* callback;
+    if (!PyArg_ParseTuple(args, "L:cancel_timer", &timer_id))
+        return NULL;
+
+    if (!CancelTimer(timer_id, &callback))
+        Py_RETURN_FALSE;
+
+    Py_DECREF((PyObject*)callback);
     Py_RETURN_TRUE;
 }
 
+/*
+ * ================================================================
+ *                      post_console_command
+ * ================================================================
+*/
+
+// The post_* functions are safe to call from any thread. What they post is
+// done at the start of the next frame, in the order it was posted in.
+static PyObject* PyMinqlx_PostConsoleCommand(PyObject* self, PyObject* args) {
+    char* cmd;
+    if (!PyArg_ParseTuple(args, "s:post_console_command", &cmd))
+        return NULL;
+
+    if (!InjectOperation(INJECT_CONSOLE_COMMAND, 0, NULL, cmd, NULL))
+        return PyErr_NoMemory();
+
+    Py_RETURN_NONE;
+}
+
+/*
+ * ================================================================
+ *                      post_server_command
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_PostServerCommand(PyObject* self, PyObject* args) {
+    PyObject* client_id = 0;
+    int i = -1;
+    char* cmd;
+    if (!PyArg_ParseTuple(args, "Os:post_server_command", &client_id, &cmd))
+        return NULL;
+
+    if (client_id != Py_None) {
+        if (!PyLong_Check(client_id)) {
+            PyErr_Format(PyExc_ValueError,
+                         "client_id needs to be a number from 0 to %d, or None.",
+                         sv_maxclients->integer);
+            return NULL;
+        }
+        i = PyLong_AsLong(client_id);
+        if (i < 0 || i >= sv_maxclients->integer) {
+            PyErr_Format(PyExc_ValueError,
+                         "client_id needs to be a number from 0 to %d, or None.",
+                         sv_maxclients->integer);
+            return NULL;
+        }
+    }
+
+    if (!InjectOperation(INJECT_SERVER_COMMAND, i, NULL, cmd, NULL))
+        return PyErr_NoMemory();
+
+    Py_RETURN_NONE;
+}
+
+/*
+ * ================================================================
+ *                       post_configstring
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_PostConfigstring(PyObject* self, PyObject* args) {
+    int i;
+    char* cs;
+    if (!PyArg_ParseTuple(args, "is:post_configstring", &i, &cs))
+        return NULL;
+    else if (i < 0 || i >= MAX_CONFIGSTRINGS) {
+        PyErr_Format(PyExc_ValueError,
+                     "index needs to be a number from 0 to %d.",
+                     MAX_CONFIGSTRINGS - 1);
+        return NULL;
+    }
+
+    if (!InjectOperation(INJECT_CONFIGSTRING, i, NULL, cs, NULL))
+        return PyErr_NoMemory();
+
+    Py_RETURN_NONE;
+}
+
+/*
+ * ================================================================
+ *                           post_cvar
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_PostCvar(PyObject* self, PyObject* args) {
+    char *name, *value;
+    if (!PyArg_ParseTuple(args, "ss:post_cvar", &name, &value))
+        return NULL;
+
+    if (!InjectOperation(INJECT_CVAR, 0, name, value, NULL))
+        return PyErr_NoMemory();
+
+    Py_RETURN_NONE;
+}
+
+/*
+ * ================================================================
+ *                         post_callback
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_PostCallback(PyObject* self, PyObject* args) {
+    PyObject* callback;
+    if (!PyArg_ParseTuple(args, "O:post_callback", &callback))
+        return NULL;
+
+    if (!PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "The callback needs to be callable.");
+        return NULL;
+    }
+
+    // The queue holds a reference until the callback has been called.
+    Py_INCREF(callback);
+    if (!InjectOperation(INJECT_CALLBACK, 0, NULL, NULL, callback)) {
+        Py_DECREF(callback);
+        return PyErr_NoMemory();
+    }
+
+    Py_RETURN_NONE;
+}
+
+/*
+ * ================================================================
+ *                        yield_to_engine
+ * ================================================================
+*/
+
+// For threads doing a lot of work in Python. The engine thread can otherwise
+// be left waiting a whole switch interval for the GIL in the middle of a frame.
+static PyObject* PyMinqlx_YieldToEngine(PyObject* self, PyObject* args) {
+#ifdef Py_GIL_DISABLED
+    Py_RETURN_FALSE; // Nothing to yield.
+#else
+    if (!qlx_gilYield || !qlx_gilYield->integer || !__atomic_load_n(&engine_wants_gil, __ATOMIC_ACQUIRE))
+        Py_RETURN_FALSE;
+
+    // Let go until the engine thread has it, and then queue up behind it.
+    // Don't wait long though, in case someone else got it first.
+    Py_BEGIN_ALLOW_THREADS
+    struct timespec ts = {0, 50000};
+    for (int i = 0; i < 100 && __atomic_load_n(&engine_wants_gil, __ATOMIC_ACQUIRE); i++)
+        nanosleep(&ts, NULL);
+    Py_END_ALLOW_THREADS
+
+    Py_RETURN_TRUE;
+#endif
+}
+
+/*
+ * ================================================================
+ *                           gil_stats
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_GilStats(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"reset", NULL};
+    int reset = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p:gil_stats", kwlist, &reset))
+        return NULL;
+
+    // Copy everything out first, since the lock can't be held while building
+    // Python objects.
+    pthread_mutex_lock(&gil_stats_lock);
+    int count = 0;
+    for (gilStats_t* s = gil_stats; s; s = s->next)
+        count++;
+
+    gilStats_t* copies = malloc(sizeof(gilStats_t) * (count ? count : 1));
+    if (!copies) {
+        pthread_mutex_unlock(&gil_stats_lock);
+        return PyErr_NoMemory();
+    }
+
+    int i = 0;
+    for (gilStats_t* s = gil_stats; s; s = s->next) {
+        copies[i++] = *s;
+        if (reset)
+            s->calls = s->wait_ns = s->max_wait_ns = 0;
+    }
+
+    uint64_t frames = gil_frames;
+    uint64_t frame_wait = total_frame_gil_wait_ns;
+    uint64_t max_frame_wait = max_frame_gil_wait_ns;
+    if (reset)
+        gil_frames = total_frame_gil_wait_ns = max_frame_gil_wait_ns = 0;
+    pthread_mutex_unlock(&gil_stats_lock);
+
+    PyObject* dispatchers = PyDict_New();
+    for (i = 0; dispatchers && i < count; i++) {
+        PyObject* entry = Py_BuildValue("(Kdd)", (unsigned long long)copies[i].calls,
+                                        copies[i].wait_ns / 1e9, copies[i].max_wait_ns / 1e9);
+        if (!entry || PyDict_SetItemString(dispatchers, copies[i].name, entry))
+            Py_CLEAR(dispatchers);
+        Py_XDECREF(entry);
+    }
+    free(copies);
+
+    if (!dispatchers)
+        return NULL;
+
+    return Py_BuildValue("{s:K,s:d,s:d,s:N}",
+                         "frames", (unsigned long long)frames,
+                         "frame_wait", frame_wait / 1e9,
+                         "max_frame_wait", max_frame_wait / 1e9,
+                         "dispatchers", dispatchers);
+}
+
+/*
+ * ================================================================
+ *                           hook_stack
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_HookStack(PyObject* self, PyObject* args) {
+    int depth = __atomic_load_n(&hook_depth, __ATOMIC_ACQUIRE);
+    if (depth > MAX_HOOK_DEPTH)
+        depth = MAX_HOOK_DEPTH;
+    else if (depth < 0)
+        depth = 0;
+
+    PyObject* ret = PyTuple_New(depth);
+    if (!ret)
+        return NULL;
+
+    for (int i = 0; i < depth; i++) {
+        PyObject* name = PyUnicode_FromString(hook_stack[i]);
+        if (!name) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(ret, i, name);
+    }
+
+    return ret;
+}
+
+#ifdef WORKER_INTERPRETERS
+/*
+ * ================================================================
+ *                          start_worker
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_StartWorker(PyObject* self, PyObject* args) {
+    char *name, *module, *path;
+    if (!PyArg_ParseTuple(args, "sss:start_worker", &name, &module, &path))
+        return NULL;
+    else if (!*name || strlen(name) >= MAX_WORKER_NAME) {
+        PyErr_Format(PyExc_ValueError, "The name needs to be from 1 to %d characters long.", MAX_WORKER_NAME - 1);
+        return NULL;
+    }
+
+    int res = StartWorker(name, module, path);
+    if (res == -1) {
+        PyErr_Format(PyExc_ValueError, "There's already a worker called '%s'.", name);
+        return NULL;
+    }
+    else if (res) {
+        PyErr_Format(PyExc_RuntimeError, "Can't start more than %d workers.", MAX_WORKERS);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/*
+ * ================================================================
+ *                         send_to_worker
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_SendToWorker(PyObject* self, PyObject* args) {
+    char* name;
+    Py_buffer data;
+    if (!PyArg_ParseTuple(args, "ss*:send_to_worker", &name, &data))
+        return NULL;
+
+    int sent = SendToWorker(name, data.buf, data.len);
+    PyBuffer_Release(&data);
+
+    return PyBool_FromLong(sent);
+}
+#endif
+
+/*
+ * ================================================================
+ *                         set_event_sync
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_SetEventSync(PyObject* self, PyObject* args) {
+    char* event;
+    int sync;
+    if (!PyArg_ParseTuple(args, "sp:set_event_sync", &event, &sync))
+        return NULL;
+
+    if (!strcmp(event, "console_print"))
+        SetEventSync(BATCH_CONSOLE_PRINT, sync);
+    else if (!strcmp(event, "server_command"))
+        SetEventSync(BATCH_SERVER_COMMAND, sync);
+    else if (!strcmp(event, "set_configstring"))
+        SetEventSync(BATCH_SET_CONFIGSTRING, sync);
+    else {
+        PyErr_Format(PyExc_ValueError, "'%s' is not an event that can be batched.", event);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/*
+ * ================================================================
+ *                           add_zone
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_AddZone(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"shape", "bounds", "team", "dwell", NULL};
+    const char* shape;
+    PyObject* bounds;
+    float dwell = 0;
+    zone_t zone;
+    memset(&zone, 0, sizeof(zone));
+    zone.team = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sO|if:add_zone", kwlist, &shape, &bounds, &zone.team, &dwell))
+        return NULL;
+
+    PyObject* bounds_tuple = PySequence_Tuple(bounds);
+    if (!bounds_tuple)
+        return NULL;
+
+    int res;
+    if (!strcmp(shape, "box")) {
+        zone.shape = ZONE_BOX;
+        res = PyArg_ParseTuple(bounds_tuple, "(fff)(fff):add_zone",
+            &zone.mins[0], &zone.mins[1], &zone.mins[2], &zone.maxs[0], &zone.maxs[1], &zone.maxs[2]);
+        for (int i = 0; res && i < 3; i++) {
+            if (zone.mins[i] > zone.maxs[i]) {
+                float tmp = zone.mins[i];
+                zone.mins[i] = zone.maxs[i];
+                zone.maxs[i] = tmp;
+            }
+        }
+    }
+    else if (!strcmp(shape, "sphere")) {
+        zone.shape = ZONE_SPHERE;
+        res = PyArg_ParseTuple(bounds_tuple, "(fff)f:add_zone",
+            &zone.center[0], &zone.center[1], &zone.center[2], &zone.radius);
+    }
+    else if (!strcmp(shape, "cylinder")) {
+        zone.shape = ZONE_CYLINDER;
+        res = PyArg_ParseTuple(bounds_tuple, "(fff)ff:add_zone",
+            &zone.center[0], &zone.center[1], &zone.center[2], &zone.radius, &zone.height);
+    }
+    else {
+        Py_DECREF(bounds_tuple);
+        PyErr_Format(PyExc_ValueError, "shape needs to be \"box\", \"sphere\" or \"cylinder\".");
+        return NULL;
+    }
+    Py_DECREF(bounds_tuple);
+
+    if (!res)
+        return NULL;
+    else if (zone.radius < 0 || zone.height < 0 || dwell < 0) {
+        PyErr_Format(PyExc_ValueError, "radius, height and dwell cannot be negative.");
+        return NULL;
+    }
+
+    zone.dwell_time = (int)(dwell * 1000);
+    int zone_id = AddZone(&zone);
+    if (zone_id == -1) {
+        PyErr_Format(PyExc_RuntimeError, "The maximum of %d zones has been reached.", MAX_ZONES);
+        return NULL;
+    }
+
+    return PyLong_FromLong(zone_id);
+}
+
+/*
+ * ================================================================
+ *                          remove_zone
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_RemoveZone(PyObject* self, PyObject* args) {
+    int zone_id;
+    if (!PyArg_ParseTuple(args, "i:remove_zone", &zone_id))
+        return NULL;
+
+    return PyBool_FromLong(RemoveZone(zone_id));
+}
+
+/*
+ * ================================================================
+ *                          clear_zones
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_ClearZones(PyObject* self, PyObject* args) {
+    ClearZones();
+    Py_RETURN_NONE;
+}
+
+/*
+ * ================================================================
+ *                       entities_in_radius
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_EntitiesInRadius(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"origin", "radius", "etype", NULL};
+    static __thread int ids[MAX_GENTITIES];
+    vec3_t origin;
+    float radius;
+    int etype = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "(fff)f|i:entities_in_radius", kwlist,
+        &origin[0], &origin[1], &origin[2], &radius, &etype))
+        return NULL;
+    else if (radius < 0) {
+        PyErr_Format(PyExc_ValueError, "radius cannot be negative.");
+        return NULL;
+    }
+
+    int count = EntitiesInRadius(origin, radius, etype, ids, MAX_GENTITIES);
+    PyObject* ret = PyList_New(count);
+    if (!ret)
+        return NULL;
+
+    for (int i = 0; i < count; i++)
+        PyList_SET_ITEM(ret, i, PyLong_FromLong(ids[i]));
+
+    return ret;
+}
+
+/*
+ * ================================================================
+ *                        nearest_player
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_NearestPlayer(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"origin", "team", "exclude", NULL};
+    vec3_t origin;
+    int team = -1, exclude = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "(fff)|ii:nearest_player", kwlist,
+        &origin[0], &origin[1], &origin[2], &team, &exclude))
+        return NULL;
+
+    int client_id = NearestPlayer(origin, team, exclude);
+    if (client_id == -1)
+        Py_RETURN_NONE;
+
+    return PyLong_FromLong(client_id);
+}
+
+/*
+ * ================================================================
+ *                         find_entities
+ * ================================================================
+*/
+
+static PyObject* PyMinqlx_FindEntities(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"classname", "etype", "gitype", "dropped", NULL};
+    static __thread int ids[MAX_GENTITIES];
+    entityFilter_t filter = {NULL, -1, -1, -1};
+    PyObject* dropped = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ziiO:find_entities", kwlist,
+        &filter.classname, &filter.etype, &filter.gitype, &dropped))
+        return NULL;
+
+    if (dropped != Py_None)
+        filter.dropped = PyObject_IsTrue(dropped);
+
+    int count = FindEntities(&filter, ids, MAX_GENTITIES);
+    PyObject* ret = PyList_New(count);
+    if (!ret)
+        return NULL;
+
+    for (int i = 0; i < count; i++)
+        PyList_SET_ITEM(ret, i, PyLong_FromLong(ids[i]));
+
+    return ret;
+}
+
 /*
  * ================================================================
  *             Module definition and initialization
@@ -1691,7 +2992,7 @@ static PyMethodDef minqlxMethods[] = {
 	{"get_userinfo", PyMinqlx_GetUserinfo, METH_VARARGS,
 	 "Returns a string with a player's userinfo."},
     {"send_server_command", PyMinqlx_SendServerCommand, METH_VARARGS,
-     "Sends a server command to either one specific client or all the clients."},
+     "Sends a server command to either one specific client or all the clients. Returns False if the client can't take any more commands right now."},
 	{"client_command", PyMinqlx_ClientCommand, METH_VARARGS,
 	 "Tells the server to process a command from a specific client."},
 	{"console_command", PyMinqlx_ConsoleCommand, METH_VARARGS,
@@ -1714,6 +3015,8 @@ static PyMethodDef minqlxMethods[] = {
 	 "Forces the current vote to either fail or pass."},
 	{"add_console_command", PyMinqlx_AddConsoleCommand, METH_VARARGS,
 	 "Adds a console command that will be handled by Python code."},
+    {"add_named_console_command", PyMinqlx_AddNamedConsoleCommand, METH_VARARGS,
+     "Adds a console command whose name is passed to the console_command handler along with its arguments."},
     {"register_handler", PyMinqlx_RegisterHandler, METH_VARARGS,
      "Register an event handler. Can be called more than once per event, but only the last one will work."},
     {"player_state", PyMinqlx_PlayerState, METH_VARARGS,
@@ -1740,6 +3043,10 @@ static PyMethodDef minqlxMethods[] = {
      "Sets a player's powerups."},
     {"set_holdable", PyMinqlx_SetHoldable, METH_VARARGS,
      "Sets a player's holdable item."},
+    {"apply_player_state", PyMinqlx_ApplyPlayerState, METH_VARARGS,
+     "Applies health, armor, weapons, weapon, ammo, powerups and holdable changes to many players in one call."},
+    {"set_spawn_template", (PyCFunction)(void(*)(void))PyMinqlx_SetSpawnTemplate, METH_VARARGS | METH_KEYWORDS,
+     "Sets the changes applied to players of a team when they spawn, optionally only for a factory. Pass None to remove it."},
     {"drop_holdable", PyMinqlx_DropHoldable, METH_VARARGS,
      "Drops player's holdable item."},
     {"set_flight", PyMinqlx_SetFlight, METH_VARARGS,
@@ -1760,16 +3067,64 @@ static PyMethodDef minqlxMethods[] = {
      "Removes all current kamikaze timers."},
     {"spawn_item", PyMinqlx_SpawnItem, METH_VARARGS,
      "Spawns item with specified coordinates."},
+    {"spawn_items", PyMinqlx_SpawnItems, METH_VARARGS,
+     "Spawns a list of (item, (x, y, z)[, respawn wait]) or the items in a layout file, relative to fs_homepath. Returns the entity IDs."},
     {"remove_dropped_items", PyMinqlx_RemoveDroppedItems, METH_NOARGS,
      "Removes all dropped items."},
     {"slay_with_mod", PyMinqlx_SlayWithMod, METH_VARARGS,
      "Slay player with mean of death."},
     {"replace_items", PyMinqlx_ReplaceItems, METH_VARARGS,
-     "Replaces target entity's item with specified one."},
+     "Replaces target entity's item with specified one, or applies a dict of such replacements with a single CS_ITEMS update."},
     {"dev_print_items", PyMinqlx_DevPrintItems, METH_NOARGS,
      "Prints all items and entity numbers to server console."},
     {"force_weapon_respawn_time", PyMinqlx_ForceWeaponRespawnTime, METH_VARARGS,
      "Force all weapons to have a specified respawn time, overriding custom map respawn times set for them."},
+    {"drain_usercmds", PyMinqlx_DrainUsercmds, METH_VARARGS,
+     "Returns and clears a player's buffered usercmds as packed bytes. Unpack with USERCMD_FORMAT."},
+    {"pending_usercmds", PyMinqlx_PendingUsercmds, METH_VARARGS,
+     "Returns the number of buffered usercmds for a player."},
+    {"server_command_queue", PyMinqlx_ServerCommandQueue, METH_VARARGS,
+     "Returns the number of server commands held back for a player until they acknowledge earlier ones."},
+    {"add_timer", (PyCFunction)(void(*)(void))PyMinqlx_AddTimer, METH_VARARGS | METH_KEYWORDS,
+     "Calls a function after a number of seconds of game time, not counting pauses, or wall clock time. Returns the timer ID."},
+    {"cancel_timer", PyMinqlx_CancelTimer, METH_VARARGS,
+     "Cancels a timer added with add_timer. Returns False if it already went off or was cancelled."},
+    {"post_console_command", PyMinqlx_PostConsoleCommand, METH_VARARGS,
+     "Executes a console command at the start of the next frame. Safe to call from any thread."},
+    {"post_server_command", PyMinqlx_PostServerCommand, METH_VARARGS,
+     "Sends a server command to a player, or everyone if None, at the start of the next frame. Safe to call from any thread."},
+    {"post_configstring", PyMinqlx_PostConfigstring, METH_VARARGS,
+     "Sets a configstring at the start of the next frame. Safe to call from any thread."},
+    {"post_cvar", PyMinqlx_PostCvar, METH_VARARGS,
+     "Sets a cvar, creating it if needed, at the start of the next frame. Safe to call from any thread."},
+    {"post_callback", PyMinqlx_PostCallback, METH_VARARGS,
+     "Calls a function without arguments on the main thread at the start of the next frame. Safe to call from any thread."},
+    {"yield_to_engine", PyMinqlx_YieldToEngine, METH_NOARGS,
+     "Briefly lets go of the GIL if qlx_gilYield is on and the engine thread is waiting for it. Returns whether it did."},
+    {"gil_stats", (PyCFunction)(void(*)(void))PyMinqlx_GilStats, METH_VARARGS | METH_KEYWORDS,
+     "Returns how long the engine thread has waited for the GIL, in total, per frame and per dispatcher."},
+    {"hook_stack", PyMinqlx_HookStack, METH_NOARGS,
+     "Returns the names of the hooks and dispatchers the engine thread is in, outermost first."},
+#ifdef WORKER_INTERPRETERS
+    {"start_worker", PyMinqlx_StartWorker, METH_VARARGS,
+     "Imports a module in a sub-interpreter with its own GIL and calls its run() in a thread of its own."},
+    {"send_to_worker", PyMinqlx_SendToWorker, METH_VARARGS,
+     "Sends bytes or a string to a worker. Returns False if there's no worker by that name running."},
+#endif
+    {"set_event_sync", PyMinqlx_SetEventSync, METH_VARARGS,
+     "Sets whether or not an event that can be batched with qlx_batchEvents has to go off right away."},
+    {"add_zone", (PyCFunction)(void(*)(void))PyMinqlx_AddZone, METH_VARARGS | METH_KEYWORDS,
+     "Adds a box, sphere or cylinder zone that triggers zone_enter and zone_exit. Returns the zone ID."},
+    {"remove_zone", PyMinqlx_RemoveZone, METH_VARARGS,
+     "Removes a zone added with add_zone."},
+    {"clear_zones", PyMinqlx_ClearZones, METH_NOARGS,
+     "Removes all zones."},
+    {"entities_in_radius", (PyCFunction)(void(*)(void))PyMinqlx_EntitiesInRadius, METH_VARARGS | METH_KEYWORDS,
+     "Returns the IDs of in-use entities within a radius of a point, optionally only of a given entity type. Entities spawned or moved since the first query of the frame may be missed."},
+    {"nearest_player", (PyCFunction)(void(*)(void))PyMinqlx_NearestPlayer, METH_VARARGS | METH_KEYWORDS,
+     "Returns the client ID of the living player closest to a point, or None."},
+    {"find_entities", (PyCFunction)(void(*)(void))PyMinqlx_FindEntities, METH_VARARGS | METH_KEYWORDS,
+     "Returns the IDs of in-use entities matching a classname, entity type, item type and/or dropped state."},
     {NULL, NULL, 0, NULL}
 };
 
@@ -1780,6 +3135,11 @@ static PyModuleDef minqlxModule = {
 
 static PyObject* PyMinqlx_InitModule(void) {
     PyObject* module = PyModule_Create(&minqlxModule);
+#ifdef Py_GIL_DISABLED
+    // Our own state is either locked or thread-local. The engine itself was
+    // never protected by the GIL, since it runs outside of Python anyway.
+    PyUnstable_Module_SetGIL(module, Py_MOD_GIL_NOT_USED);
+#endif
 
     // Set minqlx version.
     PyModule_AddStringConstant(module, "__version__", MINQLX_VERSION);
@@ -1804,6 +3164,17 @@ static PyObject* PyMinqlx_InitModule(void) {
     PyModule_AddIntMacro(module, PRI_LOW);
     PyModule_AddIntMacro(module, PRI_LOWEST);
 
+    // Usercmd buffers.
+    PyModule_AddStringMacro(module, USERCMD_FORMAT);
+    PyModule_AddIntMacro(module, USERCMD_BUFFER_SIZE);
+    PyModule_AddIntMacro(module, MAX_ZONES);
+    PyModule_AddIntMacro(module, COMMAND_QUEUE_SIZE);
+
+    // Batched event types.
+    PyModule_AddIntMacro(module, BATCH_CONSOLE_PRINT);
+    PyModule_AddIntMacro(module, BATCH_SERVER_COMMAND);
+    PyModule_AddIntMacro(module, BATCH_SET_CONFIGSTRING);
+
     // Cvar flags.
     PyModule_AddIntMacro(module, CVAR_ARCHIVE);
     PyModule_AddIntMacro(module, CVAR_USERINFO);
@@ -1837,6 +3208,32 @@ static PyObject* PyMinqlx_InitModule(void) {
     PyModule_AddIntMacro(module, TEAM_BLUE);
     PyModule_AddIntMacro(module, TEAM_SPECTATOR);
 
+    // Entity types.
+    PyModule_AddIntMacro(module, ET_GENERAL);
+    PyModule_AddIntMacro(module, ET_PLAYER);
+    PyModule_AddIntMacro(module, ET_ITEM);
+    PyModule_AddIntMacro(module, ET_MISSILE);
+    PyModule_AddIntMacro(module, ET_MOVER);
+    PyModule_AddIntMacro(module, ET_BEAM);
+    PyModule_AddIntMacro(module, ET_PORTAL);
+    PyModule_AddIntMacro(module, ET_SPEAKER);
+    PyModule_AddIntMacro(module, ET_PUSH_TRIGGER);
+    PyModule_AddIntMacro(module, ET_TELEPORT_TRIGGER);
+    PyModule_AddIntMacro(module, ET_INVISIBLE);
+    PyModule_AddIntMacro(module, ET_GRAPPLE);
+    PyModule_AddIntMacro(module, ET_TEAM);
+
+    // Item types.
+    PyModule_AddIntMacro(module, IT_BAD);
+    PyModule_AddIntMacro(module, IT_WEAPON);
+    PyModule_AddIntMacro(module, IT_AMMO);
+    PyModule_AddIntMacro(module, IT_ARMOR);
+    PyModule_AddIntMacro(module, IT_HEALTH);
+    PyModule_AddIntMacro(module, IT_POWERUP);
+    PyModule_AddIntMacro(module, IT_HOLDABLE);
+    PyModule_AddIntMacro(module, IT_PERSISTANT_POWERUP);
+    PyModule_AddIntMacro(module, IT_TEAM);
+
     // Means of death.
     PyModule_AddIntMacro(module, MOD_UNKNOWN);
     PyModule_AddIntMacro(module, MOD_SHOTGUN);
@@ -1911,10 +3308,26 @@ PyMinqlx_InitStatus_t PyMinqlx_Initialize(void) {
     }
 
     DebugPrint("Initializing Python...\n");
-    Py_SetProgramName(PYTHON_FILENAME);
     PyImport_AppendInittab("_minqlx", &PyMinqlx_InitModule);
+#ifdef WORKER_INTERPRETERS
+    PyImport_AppendInittab("_minqlx_worker", &PyMinqlx_InitWorkerModule);
+#endif
+#if PY_VERSION_HEX >= 0x03080000
+    PyConfig config;
+    PyConfig_InitPythonConfig(&config);
+    PyStatus status = PyConfig_SetString(&config, &config.program_name, PYTHON_FILENAME);
+    if (!PyStatus_Exception(status))
+        status = Py_InitializeFromConfig(&config);
+    PyConfig_Clear(&config);
+    if (PyStatus_Exception(status)) {
+        DebugPrint("Failed to initialize Python: %s\n", status.err_msg ? status.err_msg : "Unknown error.");
+        return PYM_PY_INIT_ERROR;
+    }
+#else
+    Py_SetProgramName(PYTHON_FILENAME);
     Py_Initialize();
     PyEval_InitThreads();
+#endif
 
     // Add the main module.
     PyObject* main_module = PyImport_AddModule("__main__");
@@ -1943,17 +3356,32 @@ PyMinqlx_InitStatus_t PyMinqlx_Initialize(void) {
     return PYM_SUCCESS;
 }
 
+static void ReleaseCallback(void* callback) {
+    Py_DECREF((PyObject*)callback);
+}
+
 PyMinqlx_InitStatus_t PyMinqlx_Finalize(void) {
     if (!PyMinqlx_IsInitialized()) {
         DebugPrint("%s was called before being initialized!\n", __func__);
         return PYM_NOT_INITIALIZED_ERROR;
     }
 
+    // Workers need the main interpreter's GIL to shut down, and it can't be
+    // finalized while any of them are still running in it.
+    if (StopWorkers()) {
+        DebugPrint("Python wasn't finalized, since some workers are still running.\n");
+        return PYM_WORKERS_RUNNING_ERROR;
+    }
+
     for (handler_t* h = handlers; h->name; h++) {
 		*h->handler = NULL;
 	}
 
     PyEval_RestoreThread(mainstate);
+    // Timers and queued callbacks hold references that won't mean anything
+    // to the next interpreter.
+    ClearTimers(ReleaseCallback);
+    ClearInjectQueue(ReleaseCallback);
     Py_Finalize();
     initialized = 0;
 
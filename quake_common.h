@@ -31,6 +31,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "patterns.h"
 #include "common.h"
 
+#define CS_SERVERINFO			0
 #define	CS_SCORES1				6
 #define	CS_SCORES2				7
 #define CS_VOTE_TIME			8
@@ -38,6 +39,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define	CS_VOTE_YES				10
 #define	CS_VOTE_NO				11
 #define CS_ITEMS          15
+#define CS_ROUND_STATUS   661
 
 #define MAX_CLIENTS 64
 #define MAX_CHALLENGES  1024
@@ -59,6 +61,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MAX_CONFIGSTRINGS   1024
 #define GENTITYNUM_BITS     10      // don't need to send any more
 #define MAX_GENTITIES       (1<<GENTITYNUM_BITS)
+#define ENTITYNUM_MAX_NORMAL (MAX_GENTITIES-2) // G_Spawn gives up at this one.
 #define MAX_ITEM_MODELS 4
 #define MAX_SPAWN_VARS 64
 #define MAX_SPAWN_VARS_CHARS 4096
@@ -1467,6 +1470,16 @@ extern gitem_t* bg_itemlist;
 extern int bg_numItems;
 // Cvars.
 extern cvar_t* sv_maxclients;
+extern cvar_t* qlx_perfMap;
+#ifndef NOPY
+extern cvar_t* qlx_inactivityTime;
+extern cvar_t* qlx_serverCommandPacing;
+extern cvar_t* qlx_coalesceConfigstrings;
+extern cvar_t* qlx_batchEvents;
+extern cvar_t* qlx_slowFrameInterval;
+extern cvar_t* qlx_injectBudget;
+extern cvar_t* qlx_gilYield;
+#endif
 
 // Internal QL function pointer types.
 typedef void (__cdecl *Com_Printf_ptr)(char* fmt, ...);
@@ -1529,6 +1542,7 @@ extern SV_Map_f_ptr SV_Map_f; // Used to get Cmd_Argc
 extern SV_SetConfigstring_ptr SV_SetConfigstring;
 extern SV_GetConfigstring_ptr SV_GetConfigstring;
 extern SV_DropClient_ptr SV_DropClient;
+extern SV_ClientThink_ptr SV_ClientThink;
 extern Sys_SetModuleOffset_ptr Sys_SetModuleOffset;
 extern SV_SpawnServer_ptr SV_SpawnServer;
 extern Cmd_ExecuteString_ptr Cmd_ExecuteString;
@@ -1555,7 +1569,9 @@ void __cdecl My_SV_ExecuteClientCommand(client_t *cl, char *s, qboolean clientOK
 void __cdecl My_SV_SendServerCommand(client_t* cl, char* fmt, ...);
 void __cdecl My_SV_ClientEnterWorld(client_t* client, usercmd_t* cmd);
 void __cdecl My_SV_SetConfigstring(int index, char* value);
+void __cdecl My_SV_GetConfigstring(int index, char* buffer, int bufferSize);
 void __cdecl My_SV_DropClient(client_t* drop, const char* reason);
+void __cdecl My_SV_ClientThink(client_t* cl, usercmd_t* cmd);
 void __cdecl My_Com_Printf(char* fmt, ...);
 void __cdecl My_SV_SpawnServer(char* server, qboolean killBots);
 // VM replacement functions for hooks.
@@ -1581,6 +1597,9 @@ void __cdecl PyRcon(void);
 // using Python. This means it can serve as the handler for a bunch of commands,
 // and it'll take care of redirecting it to Python.
 void __cdecl PyCommand(void);
+// Same as PyCommand, but for the console commands minqlx adds for itself, which
+// also need to know the name of the command used.
+void __cdecl PyConsoleCommand(void);
 void __cdecl RestartPython(void); // "pyrestart"
 #endif
 
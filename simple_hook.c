@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <errno.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include "trampoline.h"
 
 #if defined(__x86_64__) || defined(_M_X64)
@@ -23,12 +25,22 @@ const uint8_t NOP = 0x90;
 static void* trmps;
 static int last_trmp = 0; // trmp[TRMPS_ARRAY_SIZE]
 
+// What each trampoline slot holds, for WritePerfMap.
+typedef struct {
+    const char* name;
+    void* trampoline;
+    size_t size;
+    int written;
+} hookInfo_t;
+
+static hookInfo_t hook_info[TRMPS_ARRAY_SIZE];
+
 static void initializeTrampolines(void) {
 	trmps = mmap(NULL, (WORST_CASE * TRMPS_ARRAY_SIZE),
 		        PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
 }
 
-int Hook(void* target, void* replacement, void** func_ptr) {
+int Hook(void* target, void* replacement, void** func_ptr, const char* name) {
     TRAMPOLINE ct;
     int res, page_size;
 
@@ -74,6 +86,17 @@ int Hook(void* target, void* replacement, void** func_ptr) {
 
     *func_ptr = trmp;
 
+    // Slots get reused when HookVm hooks the VM again, so it's written out anew.
+    hook_info[last_trmp].name = name;
+    hook_info[last_trmp].trampoline = trmp;
+#if defined(__x86_64__) || defined(_M_X64)
+    // Followed by a relay to the detour that we don't use, since we jump there directly.
+    hook_info[last_trmp].size = (pint)ct.pRelay - (pint)trmp;
+#else
+    hook_info[last_trmp].size = WORST_CASE;
+#endif
+    hook_info[last_trmp].written = 0;
+
     last_trmp++;
     return 0;
 }
@@ -86,3 +109,34 @@ int seek_hook_slot( int offset ) {
     last_trmp += offset;
     return 1;
 }
+
+// Appends the trampolines hooked since the last call to /tmp/perf-<pid>.map, so that
+// perf can name the code in our anonymous mapping instead of showing bare addresses.
+// It's appended to rather than rewritten, since CPython's perf trampoline writes to
+// the same file.
+void WritePerfMap(void) {
+    char path[64], line[256];
+    int fd = -1;
+
+    for (int i = 0; i < TRMPS_ARRAY_SIZE; i++) {
+        hookInfo_t* h = &hook_info[i];
+        if (!h->name || h->written)
+            continue;
+
+        if (fd == -1) {
+            snprintf(path, sizeof(path), "/tmp/perf-%d.map", getpid());
+            fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd == -1)
+                return;
+        }
+
+        // One write per slot, so that lines can't get mixed up with CPython's.
+        int len = snprintf(line, sizeof(line), "%" PRIxPTR " %zx [minqlx] %s trampoline\n",
+            (uintptr_t)h->trampoline, h->size, h->name);
+        if (len > 0 && len < (int)sizeof(line) && write(fd, line, len) == len)
+            h->written = 1;
+    }
+
+    if (fd != -1)
+        close(fd);
+}
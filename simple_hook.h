@@ -1,7 +1,8 @@
 #ifndef SIMPLE_HOOK_H
 #define SIMPLE_HOOK_H
 
-int Hook(void* target, void* replacement, void** func_ptr);
+int Hook(void* target, void* replacement, void** func_ptr, const char* name);
 int seek_hook_slot( int offset );
+void WritePerfMap(void);
 
 #endif /* SIMPLE_HOOK_H */
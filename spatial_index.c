@@ -0,0 +1,157 @@
+#include <pthread.h>
+#include <string.h>
+#include <math.h>
+
+#include "spatial_index.h"
+#include "quake_common.h"
+
+/*
+ * A hashed grid over all in-use entities. It's rebuilt lazily, at most once per
+ * frame and only if something actually queries it, so servers that don't use it
+ * pay nothing. Each bucket is a singly linked list threaded through next[].
+ *
+ * Between rebuilds, the grid is as of the first query of the frame. Entities that
+ * moved to another cell or were spawned since are missed until the next frame,
+ * except for items minqlx itself launches, which invalidate it right away.
+ */
+static int bucket_head[SPATIAL_GRID_BUCKETS];
+static int next[MAX_GENTITIES];
+static int visited[MAX_GENTITIES];
+static int visit_stamp;
+static int valid;
+// Plugin threads can query it while the engine thread invalidates it, and the
+// rebuild and the visit stamps are shared between queries.
+static pthread_mutex_t grid_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Far beyond any map, but small enough that cell ranges can't overflow.
+#define SPATIAL_CELL_LIMIT (1 << 20)
+
+static inline int CellCoord(float x) {
+    float c = floorf(x / SPATIAL_CELL_SIZE);
+    // Converting something out of range or NaN to an int is undefined.
+    if (!(c > -SPATIAL_CELL_LIMIT))
+        return -SPATIAL_CELL_LIMIT;
+    else if (c > SPATIAL_CELL_LIMIT)
+        return SPATIAL_CELL_LIMIT;
+    return (int)c;
+}
+
+static inline unsigned int CellBucket(int cx, int cy) {
+    return ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u) & (SPATIAL_GRID_BUCKETS - 1);
+}
+
+// Called once per frame, since pretty much everything might have moved.
+void SpatialIndexInvalidate(void) {
+    pthread_mutex_lock(&grid_lock);
+    valid = 0;
+    pthread_mutex_unlock(&grid_lock);
+}
+
+static void Rebuild(void) {
+    memset(bucket_head, -1, sizeof(bucket_head));
+
+    int num_entities = level->num_entities;
+    if (num_entities <= 0 || num_entities > MAX_GENTITIES)
+        num_entities = MAX_GENTITIES;
+
+    for (int i = 0; i < num_entities; i++) {
+        gentity_t* ent = &g_entities[i];
+        if (!ent->inuse)
+            continue;
+
+        float* origin = ent->r.currentOrigin;
+        unsigned int bucket = CellBucket(CellCoord(origin[0]), CellCoord(origin[1]));
+        next[i] = bucket_head[bucket];
+        bucket_head[bucket] = i;
+    }
+
+    valid = 1;
+}
+
+static int ScanBucket(unsigned int bucket, const vec3_t origin, float radius_sq, int etype, int* out, int count, int max) {
+    for (int i = bucket_head[bucket]; i != -1 && count < max; i = next[i]) {
+        // Several cells can hash to the same bucket, so keep track of what we've seen.
+        if (visited[i] == visit_stamp)
+            continue;
+        visited[i] = visit_stamp;
+
+        gentity_t* ent = &g_entities[i];
+        if (!ent->inuse || (etype != -1 && ent->s.eType != etype))
+            continue;
+
+        float dx = ent->r.currentOrigin[0] - origin[0];
+        float dy = ent->r.currentOrigin[1] - origin[1];
+        float dz = ent->r.currentOrigin[2] - origin[2];
+        if (dx*dx + dy*dy + dz*dz <= radius_sq)
+            out[count++] = i;
+    }
+
+    return count;
+}
+
+static int Query(const vec3_t origin, float radius, int etype, int* out, int max) {
+    if (!valid)
+        Rebuild();
+
+    if (++visit_stamp == 0) {
+        memset(visited, 0, sizeof(visited));
+        visit_stamp = 1;
+    }
+
+    int x0 = CellCoord(origin[0] - radius), x1 = CellCoord(origin[0] + radius);
+    int y0 = CellCoord(origin[1] - radius), y1 = CellCoord(origin[1] + radius);
+    float radius_sq = radius * radius;
+    int count = 0;
+
+    // A big enough radius covers every bucket anyway.
+    if ((int64_t)(x1 - x0 + 1) * (y1 - y0 + 1) >= SPATIAL_GRID_BUCKETS) {
+        for (unsigned int b = 0; b < SPATIAL_GRID_BUCKETS && count < max; b++)
+            count = ScanBucket(b, origin, radius_sq, etype, out, count, max);
+        return count;
+    }
+
+    for (int cx = x0; cx <= x1; cx++) {
+        for (int cy = y0; cy <= y1 && count < max; cy++)
+            count = ScanBucket(CellBucket(cx, cy), origin, radius_sq, etype, out, count, max);
+    }
+
+    return count;
+}
+
+/* Writes the IDs of up to max in-use entities within radius of origin into out,
+ * optionally only those of a specific eType. Pass -1 as etype to get all of them.
+ * Returns the number of entities written. */
+int EntitiesInRadius(const vec3_t origin, float radius, int etype, int* out, int max) {
+    pthread_mutex_lock(&grid_lock);
+    int count = Query(origin, radius, etype, out, max);
+    pthread_mutex_unlock(&grid_lock);
+    return count;
+}
+
+/* Returns the client ID of the living player closest to origin, or -1 if there's none.
+ * There are never more than 64 players, so we don't need the grid for this one. */
+int NearestPlayer(const vec3_t origin, int team, int exclude) {
+    int nearest = -1;
+    float nearest_sq = 0;
+
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        gentity_t* ent = &g_entities[i];
+        if (i == exclude || svs->clients[i].state != CS_ACTIVE || !ent->inuse || !ent->client || ent->health <= 0)
+            continue;
+
+        int player_team = ent->client->sess.sessionTeam;
+        if (player_team == TEAM_SPECTATOR || (team != -1 && player_team != team))
+            continue;
+
+        float dx = ent->r.currentOrigin[0] - origin[0];
+        float dy = ent->r.currentOrigin[1] - origin[1];
+        float dz = ent->r.currentOrigin[2] - origin[2];
+        float dist_sq = dx*dx + dy*dy + dz*dz;
+        if (nearest == -1 || dist_sq < nearest_sq) {
+            nearest = i;
+            nearest_sq = dist_sq;
+        }
+    }
+
+    return nearest;
+}
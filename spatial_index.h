@@ -0,0 +1,15 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include "quake_common.h"
+
+// Entities are put in square XY cells this many units wide, hashed into
+// a fixed number of buckets.
+#define SPATIAL_CELL_SIZE 128.0f
+#define SPATIAL_GRID_BUCKETS 4096
+
+void SpatialIndexInvalidate(void);
+int EntitiesInRadius(const vec3_t origin, float radius, int etype, int* out, int max);
+int NearestPlayer(const vec3_t origin, int team, int exclude);
+
+#endif /* SPATIAL_INDEX_H */
@@ -0,0 +1,421 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <Python.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "subinterpreters.h"
+#include "pyminqlx.h"
+#include "quake_common.h"
+
+#ifdef WORKER_INTERPRETERS
+
+/*
+ * Workers are plugin modules that run in a sub-interpreter of their own, each
+ * on its own thread and with its own GIL, so whatever they do never holds up
+ * the engine thread. Interpreters can't share objects, so workers only talk to
+ * the main interpreter by passing bytes through the queues here. The main
+ * interpreter gets them as worker_message events at the start of each frame,
+ * and workers send and receive them with the _minqlx_worker module.
+ */
+typedef struct {
+    char name[MAX_WORKER_NAME];
+    char* module;
+    char* path;
+    pthread_t thread;
+    int used;
+    int stopping;
+    int finished;
+    workerMessage_t* inbox;
+    workerMessage_t** inbox_tail;
+    pthread_cond_t inbox_cond;
+} worker_t;
+
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static worker_t workers[MAX_WORKERS];
+static workerMessage_t* outbox;
+static workerMessage_t** outbox_tail = &outbox;
+static int outbox_count;
+
+// Lets the worker module know which worker is importing it.
+static __thread worker_t* current_worker;
+
+static workerMessage_t* NewMessage(const char* worker, const void* data, Py_ssize_t len) {
+    workerMessage_t* msg = malloc(sizeof(workerMessage_t) + len);
+    if (!msg)
+        return NULL;
+
+    msg->next = NULL;
+    strcpy(msg->worker, worker);
+    msg->len = len;
+    memcpy(msg->data, data, len);
+    return msg;
+}
+
+static void FreeMessages(workerMessage_t* msg) {
+    while (msg) {
+        workerMessage_t* next = msg->next;
+        free(msg);
+        msg = next;
+    }
+}
+
+static void RunWorker(worker_t* w) {
+    PyObject* sys_path = PySys_GetObject("path");
+    PyObject* path = PyUnicode_FromString(w->path);
+    if (!sys_path || !path || PyList_Insert(sys_path, 0, path)) {
+        Py_XDECREF(path);
+        PyErr_Print();
+        return;
+    }
+    Py_DECREF(path);
+
+    PyObject* module = PyImport_ImportModule(w->module);
+    PyObject* result = module ? PyObject_CallMethod(module, "run", NULL) : NULL;
+    if (!result)
+        PyErr_Print();
+    Py_XDECREF(result);
+    Py_XDECREF(module);
+}
+
+static void* WorkerThread(void* arg) {
+    worker_t* w = arg;
+
+    // A new interpreter has to be created from an existing one.
+    PyThreadState* main_tstate = PyThreadState_New(PyInterpreterState_Main());
+    PyEval_RestoreThread(main_tstate);
+
+    PyInterpreterConfig config = {
+        .use_main_obmalloc = 0,
+        .allow_fork = 0,
+        .allow_exec = 0,
+        .allow_threads = 1,
+        .allow_daemon_threads = 0,
+        .check_multi_interp_extensions = 1,
+        .gil = PyInterpreterConfig_OWN_GIL,
+    };
+
+    // The main interpreter's GIL is let go of once the new one has its own.
+    PyThreadState* tstate = NULL;
+    PyStatus status = Py_NewInterpreterFromConfig(&tstate, &config);
+    if (PyStatus_Exception(status))
+        DebugPrint("Failed to create an interpreter for worker %s: %s\n", w->name,
+                   status.err_msg ? status.err_msg : "Unknown error.");
+    else {
+        current_worker = w;
+        RunWorker(w);
+        current_worker = NULL;
+        Py_EndInterpreter(tstate);
+        PyEval_RestoreThread(main_tstate);
+    }
+
+    PyThreadState_Clear(main_tstate);
+    PyThreadState_DeleteCurrent();
+
+    pthread_mutex_lock(&worker_lock);
+    w->finished = 1;
+    pthread_mutex_unlock(&worker_lock);
+    return NULL;
+}
+
+// Must be called with the worker lock held, after its thread is done.
+static void ReleaseWorker(worker_t* w) {
+    free(w->module);
+    free(w->path);
+    FreeMessages(w->inbox);
+    pthread_cond_destroy(&w->inbox_cond);
+    memset(w, 0, sizeof(worker_t));
+}
+
+static int FindWorker(const char* name) {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        if (workers[i].used && !strcmp(workers[i].name, name))
+            return i;
+    }
+
+    return -1;
+}
+
+// Returns 0 on success, -1 if the name is taken and -2 if we can't start any more.
+int StartWorker(const char* name, const char* module, const char* path) {
+    pthread_mutex_lock(&worker_lock);
+    int i = FindWorker(name);
+    if (i != -1 && workers[i].finished) {
+        // It's done with the lock once it's finished, so it's safe to wait here.
+        pthread_join(workers[i].thread, NULL);
+        ReleaseWorker(&workers[i]);
+    }
+    else if (i != -1) {
+        pthread_mutex_unlock(&worker_lock);
+        return -1;
+    }
+
+    for (i = 0; i < MAX_WORKERS && workers[i].used; i++);
+    if (i == MAX_WORKERS) {
+        pthread_mutex_unlock(&worker_lock);
+        return -2;
+    }
+
+    worker_t* w = &workers[i];
+    strncpy(w->name, name, sizeof(w->name) - 1);
+    w->module = strdup(module);
+    w->path = strdup(path);
+    w->inbox_tail = &w->inbox;
+    pthread_cond_init(&w->inbox_cond, NULL);
+    w->used = 1;
+
+    if (!w->module || !w->path || pthread_create(&w->thread, NULL, WorkerThread, w)) {
+        free(w->module);
+        free(w->path);
+        pthread_cond_destroy(&w->inbox_cond);
+        memset(w, 0, sizeof(worker_t));
+        pthread_mutex_unlock(&worker_lock);
+        return -2;
+    }
+
+    pthread_mutex_unlock(&worker_lock);
+    return 0;
+}
+
+// Returns 0 if there's no worker with that name.
+int SendToWorker(const char* name, const char* data, Py_ssize_t len) {
+    pthread_mutex_lock(&worker_lock);
+    int i = FindWorker(name);
+    workerMessage_t* msg = i != -1 && !workers[i].finished ? NewMessage(name, data, len) : NULL;
+    if (msg) {
+        *workers[i].inbox_tail = msg;
+        workers[i].inbox_tail = &msg->next;
+        pthread_cond_signal(&workers[i].inbox_cond);
+    }
+    pthread_mutex_unlock(&worker_lock);
+
+    return msg != NULL;
+}
+
+// Called at the start of every frame. Like with the inject queue, no more than
+// qlx_injectBudget messages are dispatched per frame, and the rest are left for
+// the next one.
+void DrainWorkerMessages(void) {
+    int budget = qlx_injectBudget ? qlx_injectBudget->integer : 0;
+
+    pthread_mutex_lock(&worker_lock);
+    workerMessage_t* msg = outbox;
+    workerMessage_t** tail = &outbox;
+    int count = 0;
+    while (*tail && (budget <= 0 || count < budget)) {
+        tail = &(*tail)->next;
+        count++;
+    }
+    outbox = *tail;
+    *tail = NULL;
+    if (!outbox)
+        outbox_tail = &outbox;
+    outbox_count -= count;
+    pthread_mutex_unlock(&worker_lock);
+
+    if (msg)
+        WorkerMessageDispatcher(msg, count);
+    FreeMessages(msg);
+}
+
+// Called before Python is finalized, with the main interpreter's GIL released.
+// Workers are expected to return from run() once receive() returns None while
+// stopping() is true. One that doesn't within WORKER_STOP_TIMEOUT seconds is
+// left running, and the number of those is returned, since Python can't be
+// finalized under them.
+int StopWorkers(void) {
+    pthread_mutex_lock(&worker_lock);
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        if (workers[i].used) {
+            workers[i].stopping = 1;
+            pthread_cond_broadcast(&workers[i].inbox_cond);
+        }
+    }
+    pthread_mutex_unlock(&worker_lock);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += WORKER_STOP_TIMEOUT;
+
+    // Nothing else starts workers while Python is down, so used can be read
+    // without the lock, which the workers need to finish.
+    int running = 0;
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        if (!workers[i].used)
+            continue;
+
+        DebugPrint("Waiting for worker %s to stop...\n", workers[i].name);
+        if (pthread_timedjoin_np(workers[i].thread, NULL, &deadline)) {
+            DebugPrint("WARNING: Worker %s didn't stop within %d seconds.\n",
+                       workers[i].name, WORKER_STOP_TIMEOUT);
+            running++;
+            continue;
+        }
+
+        pthread_mutex_lock(&worker_lock);
+        ReleaseWorker(&workers[i]);
+        pthread_mutex_unlock(&worker_lock);
+    }
+
+    if (running)
+        return running;
+
+    pthread_mutex_lock(&worker_lock);
+    FreeMessages(outbox);
+    outbox = NULL;
+    outbox_tail = &outbox;
+    outbox_count = 0;
+    pthread_mutex_unlock(&worker_lock);
+    return 0;
+}
+
+/*
+ * ================================================================
+ *                   The _minqlx_worker module
+ * ================================================================
+*/
+
+static worker_t* ModuleWorker(PyObject* module) {
+    return *(worker_t**)PyModule_GetState(module);
+}
+
+static PyObject* PyMinqlxWorker_Send(PyObject* self, PyObject* args) {
+    Py_buffer data;
+    if (!PyArg_ParseTuple(args, "s*:send", &data))
+        return NULL;
+
+    worker_t* w = ModuleWorker(self);
+    workerMessage_t* msg = NewMessage(w->name, data.buf, data.len);
+    PyBuffer_Release(&data);
+    if (!msg)
+        return PyErr_NoMemory();
+
+    pthread_mutex_lock(&worker_lock);
+    int full = outbox_count >= MAX_WORKER_OUTBOX;
+    if (!full) {
+        *outbox_tail = msg;
+        outbox_tail = &msg->next;
+        outbox_count++;
+    }
+    pthread_mutex_unlock(&worker_lock);
+
+    if (full) {
+        free(msg);
+        Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject* PyMinqlxWorker_Receive(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"timeout", NULL};
+    PyObject* timeout_obj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O:receive", kwlist, &timeout_obj))
+        return NULL;
+
+    double timeout = -1;
+    if (timeout_obj != Py_None) {
+        timeout = PyFloat_AsDouble(timeout_obj);
+        if (timeout == -1 && PyErr_Occurred())
+            return NULL;
+        else if (timeout < 0) {
+            PyErr_SetString(PyExc_ValueError, "The timeout needs to be a positive number of seconds.");
+            return NULL;
+        }
+    }
+
+    worker_t* w = ModuleWorker(self);
+    workerMessage_t* msg;
+    Py_BEGIN_ALLOW_THREADS
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)timeout;
+    deadline.tv_nsec += (long)((timeout - (time_t)timeout) * 1e9);
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&worker_lock);
+    while (!w->inbox && !w->stopping) {
+        if (timeout < 0)
+            pthread_cond_wait(&w->inbox_cond, &worker_lock);
+        else if (pthread_cond_timedwait(&w->inbox_cond, &worker_lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+
+    msg = w->inbox;
+    if (msg) {
+        w->inbox = msg->next;
+        if (!w->inbox)
+            w->inbox_tail = &w->inbox;
+    }
+    pthread_mutex_unlock(&worker_lock);
+    Py_END_ALLOW_THREADS
+
+    if (!msg)
+        Py_RETURN_NONE;
+
+    PyObject* ret = PyBytes_FromStringAndSize(msg->data, msg->len);
+    free(msg);
+    return ret;
+}
+
+static PyObject* PyMinqlxWorker_Stopping(PyObject* self, PyObject* args) {
+    worker_t* w = ModuleWorker(self);
+    pthread_mutex_lock(&worker_lock);
+    int stopping = w->stopping;
+    pthread_mutex_unlock(&worker_lock);
+
+    return PyBool_FromLong(stopping);
+}
+
+static PyMethodDef workerMethods[] = {
+    {"send", PyMinqlxWorker_Send, METH_VARARGS,
+     "Sends bytes or a string to the main interpreter, where it triggers the worker_message event. "
+     "Returns False if too many messages are already waiting to be dispatched."},
+    {"receive", (PyCFunction)(void(*)(void))PyMinqlxWorker_Receive, METH_VARARGS | METH_KEYWORDS,
+     "Waits for bytes sent with minqlx.send_to_worker. Returns None on timeout, or once the worker is stopping."},
+    {"stopping", PyMinqlxWorker_Stopping, METH_NOARGS,
+     "Returns whether or not the worker should return from run() because Python is shutting down."},
+    {NULL, NULL, 0, NULL}
+};
+
+static int PyMinqlxWorker_Exec(PyObject* module) {
+    if (!current_worker) {
+        PyErr_SetString(PyExc_ImportError, "_minqlx_worker can only be imported by worker interpreters.");
+        return -1;
+    }
+
+    *(worker_t**)PyModule_GetState(module) = current_worker;
+    return PyModule_AddStringConstant(module, "name", current_worker->name);
+}
+
+static PyModuleDef_Slot workerSlots[] = {
+    {Py_mod_exec, PyMinqlxWorker_Exec},
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#ifdef Py_GIL_DISABLED
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
+};
+
+static struct PyModuleDef workerModule = {
+    PyModuleDef_HEAD_INIT, "_minqlx_worker", "Lets worker interpreters talk to the main one.",
+    sizeof(worker_t*), workerMethods, workerSlots, NULL, NULL, NULL
+};
+
+PyObject* PyMinqlx_InitWorkerModule(void) {
+    return PyModuleDef_Init(&workerModule);
+}
+
+#else
+
+void DrainWorkerMessages(void) {}
+int StopWorkers(void) { return 0; }
+
+#endif /* WORKER_INTERPRETERS */
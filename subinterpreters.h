@@ -0,0 +1,33 @@
+#ifndef SUBINTERPRETERS_H
+#define SUBINTERPRETERS_H
+
+#include <Python.h>
+
+// Sub-interpreters only get a GIL of their own from 3.12 on.
+#if PY_VERSION_HEX >= 0x030C0000
+#define WORKER_INTERPRETERS
+#endif
+
+#define MAX_WORKERS 16
+#define MAX_WORKER_NAME 64
+// How many seconds StopWorkers waits for workers to return from run().
+#define WORKER_STOP_TIMEOUT 5
+// How many messages workers can have waiting for the main interpreter.
+#define MAX_WORKER_OUTBOX 1024
+
+typedef struct workerMessage_s {
+    struct workerMessage_s* next;
+    char worker[MAX_WORKER_NAME];
+    Py_ssize_t len;
+    char data[];
+} workerMessage_t;
+
+#ifdef WORKER_INTERPRETERS
+int StartWorker(const char* name, const char* module, const char* path);
+int SendToWorker(const char* name, const char* data, Py_ssize_t len);
+PyObject* PyMinqlx_InitWorkerModule(void);
+#endif
+void DrainWorkerMessages(void);
+int StopWorkers(void);
+
+#endif /* SUBINTERPRETERS_H */
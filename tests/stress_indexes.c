@@ -0,0 +1,262 @@
+/*
+ * Hammers the entity index, the spatial index and zones from several threads
+ * at once, like plugin threads can on a free-threaded Python. It runs outside
+ * the server against a fake world, and is meant to be built with
+ * -fsanitize=thread, which `make stress` does.
+ *
+ * Every round, the main thread changes the world on its own, much like a game
+ * frame would. Then it keeps checking zones and invalidating and resetting the
+ * indexes while the other threads query them and add and remove zones. The
+ * world doesn't change during that part, so every query result is compared
+ * against a brute-force scan.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../quake_common.h"
+#include "../pyminqlx.h"
+#include "../entity_index.h"
+#include "../spatial_index.h"
+#include "../zones.h"
+
+#define THREADS 4
+#define ROUNDS 200
+#define QUERIES_PER_ROUND 50
+#define WORLD_SIZE 4096.0f
+
+serverStatic_t* svs;
+gentity_t* g_entities;
+level_locals_t* level;
+cvar_t* sv_maxclients;
+
+static char* classnames[] = {
+    "player", "item_armor_red", "item_health_mega", "weapon_rocketlauncher", "rocket", "grenade", "func_door"
+};
+#define CLASSNAME_COUNT (int)(sizeof(classnames) / sizeof(classnames[0]))
+
+static gitem_t items[] = {
+    {"item_armor_red", .giType = IT_ARMOR},
+    {"item_health_mega", .giType = IT_HEALTH},
+    {"weapon_rocketlauncher", .giType = IT_WEAPON},
+};
+#define ITEM_COUNT (int)(sizeof(items) / sizeof(items[0]))
+
+static pthread_barrier_t round_start, round_end;
+static int failures;
+static int zone_events;
+
+static void Fail(const char* what, int round) {
+    if (__atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED) < 10)
+        fprintf(stderr, "Round %d: %s\n", round, what);
+}
+
+// The dispatchers zones.c calls. Entering removes the zone now and then, to
+// make sure handlers can change zones while CheckZones is going through them.
+void ZoneEnterDispatcher(int client_id, int zone_id) {
+    if (__atomic_fetch_add(&zone_events, 1, __ATOMIC_RELAXED) % 7 == 0)
+        RemoveZone(zone_id);
+}
+
+void ZoneExitDispatcher(int client_id, int zone_id, int inside_time) {
+    __atomic_fetch_add(&zone_events, 1, __ATOMIC_RELAXED);
+}
+
+void ZoneDwellDispatcher(int client_id, int zone_id, int inside_time) {
+    __atomic_fetch_add(&zone_events, 1, __ATOMIC_RELAXED);
+}
+
+static float RandomCoord(unsigned int* seed) {
+    return (float)rand_r(seed) / RAND_MAX * WORLD_SIZE - WORLD_SIZE / 2;
+}
+
+// Only ever called while no other thread is running.
+static void ChangeWorld(unsigned int* seed) {
+    level->time += 25;
+    level->num_entities = MAX_CLIENTS + rand_r(seed) % (ENTITYNUM_MAX_NORMAL - MAX_CLIENTS);
+
+    for (int i = 0; i < MAX_GENTITIES; i++) {
+        gentity_t* ent = &g_entities[i];
+        ent->inuse = i < level->num_entities && rand_r(seed) % 4 != 0;
+        for (int j = 0; j < 3; j++)
+            ent->r.currentOrigin[j] = RandomCoord(seed);
+
+        if (i < MAX_CLIENTS) {
+            ent->classname = classnames[0];
+            ent->s.eType = ET_PLAYER;
+            ent->item = NULL;
+            ent->health = rand_r(seed) % 4 ? 100 : 0;
+            ent->client->sess.sessionTeam = rand_r(seed) % TEAM_NUM_TEAMS;
+            memcpy(ent->client->ps.origin, ent->r.currentOrigin, sizeof(vec3_t));
+            svs->clients[i].state = ent->inuse ? CS_ACTIVE : CS_FREE;
+            continue;
+        }
+
+        int item = rand_r(seed) % (ITEM_COUNT + 1);
+        ent->item = item < ITEM_COUNT ? &items[item] : NULL;
+        ent->classname = ent->item ? ent->item->classname : classnames[1 + ITEM_COUNT + rand_r(seed) % (CLASSNAME_COUNT - 1 - ITEM_COUNT)];
+        ent->s.eType = ent->item ? ET_ITEM : ET_MISSILE + rand_r(seed) % 3;
+        ent->flags = ent->item && rand_r(seed) % 2 ? FL_DROPPED_ITEM : 0;
+    }
+
+    SpatialIndexInvalidate();
+}
+
+static int Matches(const entityFilter_t* filter, int i) {
+    gentity_t* ent = &g_entities[i];
+    if (i >= level->num_entities || !ent->inuse)
+        return 0;
+    else if (filter->classname && strcmp(filter->classname, ent->classname))
+        return 0;
+    else if (filter->etype != -1 && ent->s.eType != filter->etype)
+        return 0;
+    else if (filter->gitype != -1 && (!ent->item || (int)ent->item->giType != filter->gitype))
+        return 0;
+    else if (filter->dropped != -1 && ((ent->flags & FL_DROPPED_ITEM) != 0) != filter->dropped)
+        return 0;
+    return 1;
+}
+
+static void CheckFindEntities(unsigned int* seed, int round) {
+    static __thread int ids[MAX_GENTITIES];
+    entityFilter_t filter = {
+        rand_r(seed) % 2 ? classnames[rand_r(seed) % CLASSNAME_COUNT] : NULL,
+        rand_r(seed) % 2 ? ET_ITEM + rand_r(seed) % 4 : -1,
+        rand_r(seed) % 3 ? -1 : IT_WEAPON + rand_r(seed) % 3,
+        rand_r(seed) % 3 - 1
+    };
+
+    int count = FindEntities(&filter, ids, MAX_GENTITIES);
+    int expected = 0;
+    for (int i = 0; i < MAX_GENTITIES; i++) {
+        if (!Matches(&filter, i))
+            continue;
+        else if (expected >= count || ids[expected] != i) {
+            Fail("find_entities returned the wrong entities.", round);
+            return;
+        }
+        expected++;
+    }
+
+    if (expected != count)
+        Fail("find_entities returned too many entities.", round);
+}
+
+static void CheckEntitiesInRadius(unsigned int* seed, int round) {
+    static __thread int ids[MAX_GENTITIES];
+    static __thread char found[MAX_GENTITIES];
+    vec3_t origin = {RandomCoord(seed), RandomCoord(seed), RandomCoord(seed)};
+    float radius = rand_r(seed) % 8 ? (float)(rand_r(seed) % 1024) : 1e30f;
+    int etype = rand_r(seed) % 2 ? ET_ITEM : -1;
+
+    int count = EntitiesInRadius(origin, radius, etype, ids, MAX_GENTITIES);
+    memset(found, 0, sizeof(found));
+    for (int i = 0; i < count; i++)
+        found[ids[i]] = 1;
+
+    for (int i = 0; i < MAX_GENTITIES; i++) {
+        gentity_t* ent = &g_entities[i];
+        float dx = ent->r.currentOrigin[0] - origin[0];
+        float dy = ent->r.currentOrigin[1] - origin[1];
+        float dz = ent->r.currentOrigin[2] - origin[2];
+        int inside = i < level->num_entities && ent->inuse && (etype == -1 || ent->s.eType == etype) &&
+                     dx*dx + dy*dy + dz*dz <= radius * radius;
+        if (inside != found[i]) {
+            Fail("entities_in_radius returned the wrong entities.", round);
+            return;
+        }
+    }
+}
+
+static void ChangeZones(unsigned int* seed) {
+    int r = rand_r(seed) % 100;
+    if (r == 0) {
+        ClearZones();
+        return;
+    }
+    else if (r < 40) {
+        RemoveZone(rand_r(seed) % MAX_ZONES);
+        return;
+    }
+
+    zone_t zone = {0};
+    zone.shape = rand_r(seed) % 3;
+    zone.team = rand_r(seed) % 2 ? -1 : TEAM_RED + rand_r(seed) % 2;
+    zone.dwell_time = rand_r(seed) % 2 ? 0 : 100;
+    zone.radius = rand_r(seed) % 16 ? 64 + rand_r(seed) % 512 : 1e30f; // Now and then way too big.
+    zone.height = 256;
+    for (int i = 0; i < 3; i++) {
+        zone.center[i] = RandomCoord(seed);
+        zone.mins[i] = zone.center[i] - zone.radius;
+        zone.maxs[i] = zone.center[i] + zone.radius;
+    }
+    if (rand_r(seed) % 32 == 0)
+        zone.mins[0] = NAN;
+
+    AddZone(&zone);
+}
+
+static void* PluginThread(void* arg) {
+    unsigned int seed = (unsigned int)(pint)arg;
+    for (int round = 0; round < ROUNDS; round++) {
+        pthread_barrier_wait(&round_start);
+        for (int i = 0; i < QUERIES_PER_ROUND; i++) {
+            CheckFindEntities(&seed, round);
+            CheckEntitiesInRadius(&seed, round);
+            ChangeZones(&seed);
+        }
+        pthread_barrier_wait(&round_end);
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    static cvar_t maxclients = {.integer = MAX_CLIENTS};
+    sv_maxclients = &maxclients;
+    svs = calloc(1, sizeof(serverStatic_t));
+    svs->clients = calloc(MAX_CLIENTS, sizeof(client_t));
+    level = calloc(1, sizeof(level_locals_t));
+    g_entities = calloc(MAX_GENTITIES, sizeof(gentity_t));
+    gclient_t* clients = calloc(MAX_CLIENTS, sizeof(gclient_t));
+    if (!svs || !svs->clients || !level || !g_entities || !clients) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++)
+        g_entities[i].client = &clients[i];
+
+    pthread_barrier_init(&round_start, NULL, THREADS + 1);
+    pthread_barrier_init(&round_end, NULL, THREADS + 1);
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, PluginThread, (void*)(pint)(i + 1));
+
+    unsigned int seed = 0;
+    EntityIndexReset();
+    for (int round = 0; round < ROUNDS; round++) {
+        ChangeWorld(&seed);
+        pthread_barrier_wait(&round_start);
+        for (int i = 0; i < QUERIES_PER_ROUND; i++) {
+            CheckZones();
+            SpatialIndexInvalidate();
+            if (i % 10 == 0)
+                EntityIndexReset();
+            ResetClientZones(rand_r(&seed) % MAX_CLIENTS);
+        }
+        pthread_barrier_wait(&round_end);
+    }
+
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed.\n", failures);
+        return 1;
+    }
+
+    printf("%d rounds with %d threads passed, with %d zone events.\n", ROUNDS, THREADS, zone_events);
+    return 0;
+}
@@ -0,0 +1,257 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timers.h"
+#include "quake_common.h"
+#include "pyminqlx.h"
+
+/*
+ * Hashed timer wheels, one for each clock. A timer goes into the slot of
+ * the tick it's due on, so adding and cancelling is O(1) and every frame
+ * only has to look at the slots for the ticks that have passed since the
+ * last one. The timers themselves live in a single pool and are referred
+ * to by index, with a generation in the upper half of the ID so that a
+ * stale ID never cancels a timer that happened to reuse the slot.
+ *
+ * Python threads add and cancel timers too, so it's all behind a lock.
+ */
+typedef struct {
+    int64_t due;
+    uint64_t seq;
+    void* data;
+    uint32_t generation;
+    int clock; // -1 if free.
+    int next;
+    int prev;
+} wheelTimer_t;
+
+typedef struct {
+    int64_t now;
+    int64_t tick;
+    int initialized;
+    int slots[TIMER_WHEEL_SLOTS];
+} timerWheel_t;
+
+typedef struct {
+    int64_t due;
+    uint64_t seq;
+    void* data;
+} firedTimer_t;
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static timerWheel_t wheels[TIMER_CLOCKS];
+static wheelTimer_t* pool;
+static int pool_size;
+static int free_timers = -1;
+static uint64_t timer_seq;
+static int last_level_time;
+
+static int64_t WallClock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void InitWheel(timerWheel_t* wheel, int64_t now) {
+    wheel->now = now;
+    wheel->tick = now / TIMER_TICK - 1; // The last tick that was fully processed.
+    for (int i = 0; i < TIMER_WHEEL_SLOTS; i++)
+        wheel->slots[i] = -1;
+    wheel->initialized = 1;
+}
+
+static timerWheel_t* GetWheel(timerClock_t clock) {
+    timerWheel_t* wheel = &wheels[clock];
+    if (!wheel->initialized)
+        InitWheel(wheel, clock == TIMER_WALL_CLOCK ? WallClock() : 0);
+    else if (clock == TIMER_WALL_CLOCK)
+        wheel->now = WallClock();
+
+    return wheel;
+}
+
+static int AllocateTimer(void) {
+    if (free_timers == -1) {
+        int size = pool_size ? pool_size * 2 : 256;
+        wheelTimer_t* p = realloc(pool, size * sizeof(wheelTimer_t));
+        if (!p)
+            return -1;
+
+        for (int i = size - 1; i >= pool_size; i--) {
+            p[i].generation = 0;
+            p[i].clock = -1;
+            p[i].next = free_timers;
+            free_timers = i;
+        }
+        pool = p;
+        pool_size = size;
+    }
+
+    int index = free_timers;
+    free_timers = pool[index].next;
+    return index;
+}
+
+static void FreeTimer(int index) {
+    pool[index].clock = -1;
+    pool[index].generation++;
+    pool[index].next = free_timers;
+    free_timers = index;
+}
+
+static void Unlink(int index) {
+    wheelTimer_t* t = &pool[index];
+    timerWheel_t* wheel = &wheels[t->clock];
+
+    if (t->prev != -1)
+        pool[t->prev].next = t->next;
+    else
+        wheel->slots[(t->due / TIMER_TICK) & (TIMER_WHEEL_SLOTS - 1)] = t->next;
+    if (t->next != -1)
+        pool[t->next].prev = t->prev;
+}
+
+int64_t AddTimer(timerClock_t clock, int delay, void* data) {
+    if (delay < 0)
+        delay = 0;
+
+    pthread_mutex_lock(&timer_lock);
+    timerWheel_t* wheel = GetWheel(clock);
+    int index = AllocateTimer();
+    if (index == -1) {
+        pthread_mutex_unlock(&timer_lock);
+        return -1;
+    }
+
+    wheelTimer_t* t = &pool[index];
+    t->due = wheel->now + delay;
+    // Don't put it in a slot we've already been through.
+    if (t->due / TIMER_TICK <= wheel->tick)
+        t->due = (wheel->tick + 1) * TIMER_TICK;
+    t->seq = timer_seq++;
+    t->data = data;
+    t->clock = clock;
+
+    int* slot = &wheel->slots[(t->due / TIMER_TICK) & (TIMER_WHEEL_SLOTS - 1)];
+    t->prev = -1;
+    t->next = *slot;
+    if (*slot != -1)
+        pool[*slot].prev = index;
+    *slot = index;
+
+    int64_t timer_id = ((int64_t)t->generation << 32) | index;
+    pthread_mutex_unlock(&timer_lock);
+    return timer_id;
+}
+
+// Returns 1 and the timer's data if it was still pending.
+int CancelTimer(int64_t timer_id, void** data) {
+    int index = timer_id & 0xFFFFFFFF;
+    uint32_t generation = timer_id >> 32;
+    int ret = 0;
+
+    pthread_mutex_lock(&timer_lock);
+    if (timer_id >= 0 && index < pool_size && pool[index].clock != -1 && pool[index].generation == generation) {
+        *data = pool[index].data;
+        Unlink(index);
+        FreeTimer(index);
+        ret = 1;
+    }
+    pthread_mutex_unlock(&timer_lock);
+
+    return ret;
+}
+
+// Cancels every pending timer, passing their data to release.
+void ClearTimers(void (*release)(void*)) {
+    pthread_mutex_lock(&timer_lock);
+    for (int i = 0; i < pool_size; i++) {
+        if (pool[i].clock == -1)
+            continue;
+        release(pool[i].data);
+        Unlink(i);
+        FreeTimer(i);
+    }
+    pthread_mutex_unlock(&timer_lock);
+}
+
+// The level time starts over on a new map, so we need a new reference point.
+void SyncTimerClock(void) {
+    last_level_time = level->time;
+}
+
+static int CompareFired(const void* a, const void* b) {
+    const firedTimer_t* x = a;
+    const firedTimer_t* y = b;
+    if (x->due != y->due)
+        return x->due < y->due ? -1 : 1;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+static void AdvanceWheel(timerWheel_t* wheel, firedTimer_t** fired, int* count, int* capacity) {
+    int64_t target = wheel->now / TIMER_TICK;
+    int64_t ticks = target - wheel->tick;
+    if (ticks > TIMER_WHEEL_SLOTS)
+        ticks = TIMER_WHEEL_SLOTS;
+
+    for (int64_t i = 1; i <= ticks; i++) {
+        int index = wheel->slots[(wheel->tick + i) & (TIMER_WHEEL_SLOTS - 1)];
+        while (index != -1) {
+            wheelTimer_t* t = &pool[index];
+            int next = t->next;
+            if (t->due <= wheel->now) {
+                if (*count == *capacity) {
+                    int size = *capacity ? *capacity * 2 : 64;
+                    firedTimer_t* f = realloc(*fired, size * sizeof(firedTimer_t));
+                    if (!f)
+                        break; // Left for the next time the wheel comes around.
+                    *fired = f;
+                    *capacity = size;
+                }
+                (*fired)[(*count)++] = (firedTimer_t){t->due, t->seq, t->data};
+                Unlink(index);
+                FreeTimer(index);
+            }
+            index = next;
+        }
+    }
+
+    // Timers can still be added to the current tick, so it's only done with
+    // once the time is past it.
+    wheel->tick = target - 1;
+}
+
+void RunTimers(void) {
+    static firedTimer_t* fired;
+    static int capacity;
+    int count = 0;
+
+    // Only count level time that passes while the game isn't paused.
+    int delta = level->time - last_level_time;
+    last_level_time = level->time;
+
+    pthread_mutex_lock(&timer_lock);
+    timerWheel_t* game = GetWheel(TIMER_GAME_TIME);
+    if (delta > 0 && !level->timePauseBegin)
+        game->now += delta;
+    AdvanceWheel(game, &fired, &count, &capacity);
+    AdvanceWheel(GetWheel(TIMER_WALL_CLOCK), &fired, &count, &capacity);
+    pthread_mutex_unlock(&timer_lock);
+
+    if (!count)
+        return;
+
+    // Fire them in the order they were due, and in the order they were added
+    // if they were due at the same time.
+    qsort(fired, count, sizeof(firedTimer_t), CompareFired);
+    void** callbacks = malloc(count * sizeof(void*));
+    if (!callbacks)
+        return;
+
+    for (int i = 0; i < count; i++)
+        callbacks[i] = fired[i].data;
+    TimerDispatcher(callbacks, count);
+    free(callbacks);
+}
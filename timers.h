@@ -0,0 +1,24 @@
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <stdint.h>
+
+// Width of a wheel slot in milliseconds, and the number of slots. Timers
+// further out than a full turn of the wheel are just passed over until
+// the wheel comes around to them again.
+#define TIMER_TICK 8
+#define TIMER_WHEEL_SLOTS 1024
+
+typedef enum {
+    TIMER_GAME_TIME, // Level time, minus any time spent paused.
+    TIMER_WALL_CLOCK,
+    TIMER_CLOCKS
+} timerClock_t;
+
+int64_t AddTimer(timerClock_t clock, int delay, void* data);
+int CancelTimer(int64_t timer_id, void** data);
+void ClearTimers(void (*release)(void*));
+void SyncTimerClock(void);
+void RunTimers(void);
+
+#endif /* TIMERS_H */
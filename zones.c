@@ -0,0 +1,281 @@
+#include <pthread.h>
+#include <string.h>
+#include <math.h>
+
+#include "zones.h"
+#include "quake_common.h"
+#include "pyminqlx.h"
+
+#define ZONE_WORDS (MAX_ZONES / 64)
+
+typedef struct {
+    uint64_t bits[ZONE_WORDS];
+} zoneSet_t;
+
+typedef struct {
+    zoneSet_t inside;
+    zoneSet_t dwelled;
+    int enter_time[MAX_ZONES];
+} clientZones_t;
+
+static zone_t zones[MAX_ZONES];
+static zoneSet_t zones_used;
+static int zone_count;
+static zoneSet_t zone_grid[ZONE_GRID_BUCKETS];
+static clientZones_t client_zones[MAX_CLIENTS];
+// Plugin threads can add and remove zones while the engine thread checks them.
+// The lock is never held while dispatching, so handlers can do the same.
+static pthread_mutex_t zone_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Transitions of a single client, collected before any of them are dispatched,
+// since handlers are free to add and remove zones.
+typedef enum {
+    ZONE_EXIT,
+    ZONE_ENTER,
+    ZONE_DWELL
+} zoneTransitionType_t;
+
+typedef struct {
+    zoneTransitionType_t type;
+    int zone_id;
+    int time;
+} zoneTransition_t;
+
+// Only CheckZones uses these, and only the engine thread calls it.
+static zoneTransition_t transitions[MAX_ZONES]; // A zone is in at most one of the three at a time.
+
+// Far beyond any map, but small enough that cell ranges can't overflow.
+#define ZONE_CELL_LIMIT (1 << 20)
+
+static inline int CellCoord(float x) {
+    float c = floorf(x / ZONE_CELL_SIZE);
+    // Converting something out of range or NaN to an int is undefined.
+    if (!(c > -ZONE_CELL_LIMIT))
+        return -ZONE_CELL_LIMIT;
+    else if (c > ZONE_CELL_LIMIT)
+        return ZONE_CELL_LIMIT;
+    return (int)c;
+}
+
+static inline unsigned int CellBucket(int cx, int cy) {
+    return ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u) & (ZONE_GRID_BUCKETS - 1);
+}
+
+static void GridInsert(int zone_id) {
+    zone_t* z = &zones[zone_id];
+    int x0 = CellCoord(z->mins[0]), x1 = CellCoord(z->maxs[0]);
+    int y0 = CellCoord(z->mins[1]), y1 = CellCoord(z->maxs[1]);
+
+    // Huge zones would hit every bucket anyway, so don't bother walking the cells.
+    if ((int64_t)(x1 - x0 + 1) * (y1 - y0 + 1) >= ZONE_GRID_BUCKETS) {
+        for (int i = 0; i < ZONE_GRID_BUCKETS; i++)
+            zone_grid[i].bits[zone_id / 64] |= 1ULL << (zone_id % 64);
+        return;
+    }
+
+    for (int cx = x0; cx <= x1; cx++)
+        for (int cy = y0; cy <= y1; cy++)
+            zone_grid[CellBucket(cx, cy)].bits[zone_id / 64] |= 1ULL << (zone_id % 64);
+}
+
+static void GridRebuild(void) {
+    memset(zone_grid, 0, sizeof(zone_grid));
+    for (int i = 0; i < MAX_ZONES; i++) {
+        if (zones_used.bits[i / 64] & (1ULL << (i % 64)))
+            GridInsert(i);
+    }
+}
+
+static int ZoneContains(const zone_t* z, const vec3_t p) {
+    if (p[0] < z->mins[0] || p[0] > z->maxs[0] ||
+        p[1] < z->mins[1] || p[1] > z->maxs[1] ||
+        p[2] < z->mins[2] || p[2] > z->maxs[2])
+        return 0;
+
+    float dx = p[0] - z->center[0];
+    float dy = p[1] - z->center[1];
+    float dz = p[2] - z->center[2];
+    switch (z->shape) {
+        case ZONE_BOX:
+            return 1;
+        case ZONE_SPHERE:
+            return dx*dx + dy*dy + dz*dz <= z->radius * z->radius;
+        case ZONE_CYLINDER:
+            return dx*dx + dy*dy <= z->radius * z->radius;
+    }
+
+    return 0;
+}
+
+// Returns the zone ID, or -1 if there are no free slots.
+int AddZone(const zone_t* zone) {
+    pthread_mutex_lock(&zone_lock);
+    int id;
+    for (id = 0; id < MAX_ZONES; id++) {
+        if (!(zones_used.bits[id / 64] & (1ULL << (id % 64))))
+            break;
+    }
+    if (id == MAX_ZONES) {
+        pthread_mutex_unlock(&zone_lock);
+        return -1;
+    }
+
+    zone_t* z = &zones[id];
+    *z = *zone;
+    if (z->shape == ZONE_SPHERE || z->shape == ZONE_CYLINDER) {
+        for (int i = 0; i < 3; i++) {
+            z->mins[i] = z->center[i] - z->radius;
+            z->maxs[i] = z->center[i] + z->radius;
+        }
+        if (z->shape == ZONE_CYLINDER) {
+            z->mins[2] = z->center[2];
+            z->maxs[2] = z->center[2] + z->height;
+        }
+    }
+
+    // Nobody can be inside a zone that was just added, so make sure we don't
+    // have stale state left over from a zone that previously used the slot.
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        client_zones[i].inside.bits[id / 64] &= ~(1ULL << (id % 64));
+        client_zones[i].dwelled.bits[id / 64] &= ~(1ULL << (id % 64));
+    }
+
+    zones_used.bits[id / 64] |= 1ULL << (id % 64);
+    zone_count++;
+    GridInsert(id);
+    pthread_mutex_unlock(&zone_lock);
+    return id;
+}
+
+// Removing a zone does not trigger zone_exit for the players inside it.
+int RemoveZone(int zone_id) {
+    if (zone_id < 0 || zone_id >= MAX_ZONES)
+        return 0;
+
+    pthread_mutex_lock(&zone_lock);
+    if (!(zones_used.bits[zone_id / 64] & (1ULL << (zone_id % 64)))) {
+        pthread_mutex_unlock(&zone_lock);
+        return 0;
+    }
+
+    zones_used.bits[zone_id / 64] &= ~(1ULL << (zone_id % 64));
+    zone_count--;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        client_zones[i].inside.bits[zone_id / 64] &= ~(1ULL << (zone_id % 64));
+        client_zones[i].dwelled.bits[zone_id / 64] &= ~(1ULL << (zone_id % 64));
+    }
+
+    GridRebuild();
+    pthread_mutex_unlock(&zone_lock);
+    return 1;
+}
+
+// Zones are in map coordinates, so this is called whenever a new map is loaded.
+void ClearZones(void) {
+    pthread_mutex_lock(&zone_lock);
+    memset(&zones_used, 0, sizeof(zones_used));
+    memset(zone_grid, 0, sizeof(zone_grid));
+    memset(client_zones, 0, sizeof(client_zones));
+    zone_count = 0;
+    pthread_mutex_unlock(&zone_lock);
+}
+
+void ResetClientZones(int client_id) {
+    pthread_mutex_lock(&zone_lock);
+    memset(&client_zones[client_id], 0, sizeof(clientZones_t));
+    pthread_mutex_unlock(&zone_lock);
+}
+
+static int ZoneUsed(int zone_id) {
+    pthread_mutex_lock(&zone_lock);
+    int used = (zones_used.bits[zone_id / 64] & (1ULL << (zone_id % 64))) != 0;
+    pthread_mutex_unlock(&zone_lock);
+    return used;
+}
+
+void CheckZones(void) {
+    for (int i = 0; i < sv_maxclients->integer; i++) {
+        pthread_mutex_lock(&zone_lock);
+        if (!zone_count) {
+            pthread_mutex_unlock(&zone_lock);
+            return;
+        }
+
+        clientZones_t* cz = &client_zones[i];
+        gentity_t* ent = &g_entities[i];
+        zoneSet_t now;
+        memset(&now, 0, sizeof(now));
+        int count = 0;
+
+        // Spectators, the dead and the disconnected are in no zone at all, so
+        // they'll get zone_exit for whatever they were in.
+        int team = -1;
+        if (svs->clients[i].state == CS_ACTIVE && ent->client &&
+            ent->client->sess.sessionTeam != TEAM_SPECTATOR && ent->health > 0) {
+            team = ent->client->sess.sessionTeam;
+            float* origin = ent->client->ps.origin;
+            zoneSet_t* candidates = &zone_grid[CellBucket(CellCoord(origin[0]), CellCoord(origin[1]))];
+
+            for (int w = 0; w < ZONE_WORDS; w++) {
+                uint64_t bits = candidates->bits[w];
+                while (bits) {
+                    int id = w * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+
+                    zone_t* z = &zones[id];
+                    if (z->team != -1 && z->team != team)
+                        continue;
+                    if (ZoneContains(z, origin))
+                        now.bits[w] |= 1ULL << (id % 64);
+                }
+            }
+        }
+
+        for (int w = 0; w < ZONE_WORDS; w++) {
+            uint64_t entered = now.bits[w] & ~cz->inside.bits[w];
+            uint64_t exited = cz->inside.bits[w] & ~now.bits[w];
+            uint64_t stayed = now.bits[w] & cz->inside.bits[w] & ~cz->dwelled.bits[w];
+            cz->inside.bits[w] = now.bits[w];
+
+            while (exited) {
+                int id = w * 64 + __builtin_ctzll(exited);
+                exited &= exited - 1;
+                cz->dwelled.bits[w] &= ~(1ULL << (id % 64));
+                transitions[count++] = (zoneTransition_t){ZONE_EXIT, id, level->time - cz->enter_time[id]};
+            }
+
+            while (entered) {
+                int id = w * 64 + __builtin_ctzll(entered);
+                entered &= entered - 1;
+                cz->enter_time[id] = level->time;
+                transitions[count++] = (zoneTransition_t){ZONE_ENTER, id, 0};
+            }
+
+            while (stayed) {
+                int id = w * 64 + __builtin_ctzll(stayed);
+                stayed &= stayed - 1;
+                int inside_time = level->time - cz->enter_time[id];
+                if (zones[id].dwell_time > 0 && inside_time >= zones[id].dwell_time) {
+                    cz->dwelled.bits[w] |= 1ULL << (id % 64);
+                    transitions[count++] = (zoneTransition_t){ZONE_DWELL, id, inside_time};
+                }
+            }
+        }
+
+        pthread_mutex_unlock(&zone_lock);
+
+        for (int t = 0; t < count; t++) {
+            zoneTransition_t* tr = &transitions[t];
+            // A handler might have removed the zone in the meantime.
+            if (tr->type != ZONE_EXIT && !ZoneUsed(tr->zone_id))
+                continue;
+
+            if (tr->type == ZONE_EXIT)
+                ZoneExitDispatcher(i, tr->zone_id, tr->time);
+            else if (tr->type == ZONE_ENTER)
+                ZoneEnterDispatcher(i, tr->zone_id);
+            else
+                ZoneDwellDispatcher(i, tr->zone_id, tr->time);
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef ZONES_H
+#define ZONES_H
+
+#include "quake_common.h"
+
+#define MAX_ZONES 256
+// Zones are indexed on a grid of square XY cells this many units wide, hashed
+// into a fixed number of buckets. Each bucket is a bit field of the zones that
+// overlap any cell hashing to it.
+#define ZONE_CELL_SIZE 256.0f
+#define ZONE_GRID_BUCKETS 1024
+
+typedef enum {
+    ZONE_BOX,
+    ZONE_SPHERE,
+    ZONE_CYLINDER
+} zoneShape_t;
+
+typedef struct {
+    zoneShape_t shape;
+    vec3_t mins; // Box bounds. Filled in by AddZone for the other shapes.
+    vec3_t maxs;
+    vec3_t center; // Sphere center, or the center of the bottom of a cylinder.
+    float radius;
+    float height; // Cylinders only.
+    int team; // -1 to match players on any team.
+    int dwell_time; // In milliseconds. 0 means no zone_dwell event.
+} zone_t;
+
+int AddZone(const zone_t* zone);
+int RemoveZone(int zone_id);
+void ClearZones(void);
+void ResetClientZones(int client_id);
+void CheckZones(void);
+
+#endif /* ZONES_H */